@@ -1,17 +1,34 @@
 -- Example Lua Script for 2D Engine
 -- This script demonstrates basic entity behavior
 
-local time = 0
-
 return {
-    update = function(dt)
-        time = time + dt
-        
-        -- Example: Print to console every second
-        if math.floor(time) > math.floor(time - dt) then
-            log("Script running... time = " .. math.floor(time))
+    -- Optional: how often update runs. Skipped steps are added to dt.
+    --   update_interval = 4                  -- every 4th fixed step
+    --   update_rate = 10                     -- 10 times per second
+    --   update_lod = { {300, 1}, {800, 4} }  -- by distance to the camera
+    
+    -- Optional: run executes as a coroutine. wait(seconds), wait_frames(n) and
+    -- wait_until(event) sleep without costing anything per tick; signal(event)
+    -- wakes every script waiting on that event.
+    --
+    -- Events: emit("name", ...) queues up to four numbers as payload, delivered
+    -- once per step to handlers added with subscribe("name", fn). event("name")
+    -- returns the interned id, which every event function also accepts. The
+    -- engine emits collision_begin / collision_end (id_a, gen_a, id_b, gen_b).
+    --
+    -- Prefabs: spawn("path.prefab", x, y) returns the new entity's id and
+    -- generation; despawn(id, gen) parks it for reuse. A prefab's script keeps
+    -- its locals across reuse, so reset them in on_spawn, which runs on every spawn.
+    run = function()
+        local time = 0
+        while true do
+            wait(1)
+            time = time + 1
+            log("Script running... time = " .. time)
         end
-        
+    end,
+    
+    update = function(dt)
         -- Example: Check input
         if get_key(32) then -- Space key (SAPP_KEYCODE_SPACE = 32)
             log("Space key pressed!")
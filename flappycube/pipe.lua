@@ -1,43 +1,51 @@
 -- Flappy Cube Pipe Script
--- Scrolls pipes from right to left
+-- Scrolls a spawned pipe from right to left and returns it to the pool off screen
 
 local scroll_speed = -150  -- pixels per second
-local reset_x = 700        -- reset position when off screen
 local off_screen_x = -350  -- off screen threshold
 local has_scored = false
-local player_id = 0        -- Player entity ID
+local player_id, player_gen  -- Player entity, looked up by name
+local stopped = false
 
 return {
     init = function()
-        player_id = 0  -- Player is always entity 0 in our scene
+        player_id, player_gen = find_by_name("player")
+    end,
+    
+    -- Runs on every spawn, including reuse from the pool; events are
+    -- re-subscribed because a despawn drops the old subscriptions
+    on_spawn = function()
+        has_scored = false
+        stopped = false
+        subscribe("game_over", function() stopped = true end)
+        subscribe("restart", function() despawn(entity_id, entity_generation) end)
     end,
     
     update = function(dt)
-        if game_over then
+        if stopped then
             return
         end
         
         -- Get current position
-        local pos = get_transform(entity_id, entity_generation)
-        if not pos then return end
+        local x, y = get_position(entity_id, entity_generation)
+        if not x then return end
         
         -- Move pipe left
-        local new_x = pos.x + scroll_speed * dt
-        set_transform(entity_id, entity_generation, new_x, pos.y)
+        local new_x = x + scroll_speed * dt
+        set_transform(entity_id, entity_generation, new_x, y)
         
-        -- When pipe goes off screen left, reset to right
+        -- Off screen: back to the pool
         if new_x < off_screen_x then
-            set_transform(entity_id, entity_generation, reset_x, pos.y)
-            has_scored = false
+            despawn(entity_id, entity_generation)
+            return
         end
         
         -- Track if player passed this pipe for scoring
         -- Only score once per pipe, and only for bottom pipes (to avoid double scoring)
-        local player_pos = get_transform(player_id, 0)
-        if player_pos and not has_scored and player_pos.x > pos.x and pos.y < 0 then
+        local player_x = player_id and get_position(player_id, player_gen)
+        if player_x and not has_scored and player_x > x and y < 0 then
             has_scored = true
-            game_score = game_score + 1
-            log("Score: " .. game_score)
+            emit("pipe_passed")
         end
     end
 }
@@ -4,58 +4,60 @@
 local flap_force = 300
 local max_velocity = 400
 local dead = false
+local score = 0
 
 return {
     init = function()
         log("Flappy Cube Started! Press SPACE to flap!")
-        game_over = false
-        game_score = 0
+        subscribe("pipe_passed", function()
+            if dead then return end
+            score = score + 1
+            log("Score: " .. score)
+        end)
     end,
     
     update = function(dt)
-        if dead or game_over then
+        -- R to restart
+        if dead and get_key_down(82) then
+            score = 0
+            dead = false
+            set_transform(entity_id, entity_generation, -200, 0)
+            set_velocity(entity_id, entity_generation, 0, 0)
+            emit("restart")
+            log("Game Restarted!")
+        end
+        
+        if dead then
             return
         end
         
         -- Get current velocity
-        local vel = get_velocity(entity_id, entity_generation)
-        -- log("entity_id : "..tostring(entity_id))
-        -- log("entity_id : "..tostring(vel))
-        if not vel then return end
+        local vx, vy = get_linear_velocity(entity_id, entity_generation)
+        if not vx then return end
         
         -- SPACE to flap
         if get_key(32) then
             -- Set upward velocity instead of impulse for more responsive control
-            set_velocity(entity_id, entity_generation, vel.x, flap_force)
+            set_velocity(entity_id, entity_generation, vx, flap_force)
             log("FLAP!")
         end
         
         -- Clamp velocity
-        if vel.y > max_velocity then
-            set_velocity(entity_id, entity_generation, vel.x, max_velocity)
-        elseif vel.y < -max_velocity then
-            set_velocity(entity_id, entity_generation, vel.x, -max_velocity)
+        if vy > max_velocity then
+            set_velocity(entity_id, entity_generation, vx, max_velocity)
+        elseif vy < -max_velocity then
+            set_velocity(entity_id, entity_generation, vx, -max_velocity)
         end
         
         -- Check collision with ground/ceiling
-        local pos = get_transform(entity_id, entity_generation)
-        if pos then
-            if pos.y < -280 or pos.y > 280 then
+        local x, y = get_position(entity_id, entity_generation)
+        if x then
+            if y < -280 or y > 280 then
                 dead = true
-                game_over = true
-                log("GAME OVER! Final Score: " .. game_score)
+                emit("game_over", score)
+                log("GAME OVER! Final Score: " .. score)
                 log("Press R to restart")
             end
         end
-        
-        -- R to restart
-        if get_key_down(82) and game_over then
-            game_over = false
-            game_score = 0
-            dead = false
-            set_transform(entity_id, entity_generation, -200, 0)
-            set_velocity(entity_id, entity_generation, 0, 0)
-            log("Game Restarted!")
-        end
     end
 }
@@ -0,0 +1,32 @@
+-- Flappy Cube Pipe Spawner
+-- Spawns a pair of pipes at the right edge at a fixed interval
+
+local spawn_x = 700
+local interval = 250 / 150  -- seconds between pairs: 250 px apart at the pipes' scroll speed
+local max_offset = 80       -- random vertical shift of the gap
+local timer = 0
+local stopped = false
+
+return {
+    init = function()
+        subscribe("game_over", function() stopped = true end)
+        subscribe("restart", function()
+            stopped = false
+            timer = 0
+        end)
+    end,
+    
+    update = function(dt)
+        if stopped then
+            return
+        end
+        
+        timer = timer - dt
+        if timer <= 0 then
+            timer = timer + interval
+            local offset = math.random(-max_offset, max_offset)
+            spawn("flappycube/pipe.prefab", spawn_x, 180 + offset)
+            spawn("flappycube/pipe.prefab", spawn_x, -180 + offset)
+        end
+    end
+}
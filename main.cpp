@@ -18,13 +18,41 @@
 #include "physfs.h"
 #include "sol/sol.hpp"
 #include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <array>
 #include <algorithm>
 #include <fstream>
 #include <sstream>
+#include <chrono>
+#include <ctime>
+#include <cstring>
+#include <charconv>
+#include <string_view>
+#include <filesystem>
+#include <queue>
+#include <deque>
+#include <variant>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+// Only part of stb_rect_pack is used; keep its unused static helpers from warning
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imstb_rectpack.h"
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
 #include "nfd.h"
 
 // ============================================================================
@@ -61,12 +89,73 @@ struct Transform {
     Transform() : position({0,0}), rotation(0), scale({1,1}), parent(NULL_ENTITY) {}
 };
 
+// Handle to a texture slot in AssetManager. Copies share a reference, so a texture
+// stays loaded while any sprite, prefab template or undo step holds it; unreferenced
+// textures are evicted under the memory budget. A stale generation means the texture
+// is gone. Counts live here, ahead of every component, and are main-thread only.
+struct TextureRef {
+    struct Count {
+        uint32_t generation = 1; // Handles with generation 0 are empty
+        uint32_t refs = 0;
+        bool idle = false; // Linked into the idle list
+        uint32_t prev = UINT32_MAX;
+        uint32_t next = UINT32_MAX;
+    };
+    static std::vector<Count> counts; // By slot
+    
+    // Live slots whose last reference was dropped, oldest first. AssetManager evicts
+    // from the front; taking a reference again unlinks the slot.
+    static uint32_t idle_head;
+    static uint32_t idle_tail;
+    
+    static void link_idle(uint32_t slot) {
+        Count& count = counts[slot];
+        count.idle = true;
+        count.prev = idle_tail;
+        count.next = UINT32_MAX;
+        (idle_tail != UINT32_MAX ? counts[idle_tail].next : idle_head) = slot;
+        idle_tail = slot;
+    }
+    static void unlink_idle(uint32_t slot) {
+        Count& count = counts[slot];
+        if (!count.idle) return;
+        (count.prev != UINT32_MAX ? counts[count.prev].next : idle_head) = count.next;
+        (count.next != UINT32_MAX ? counts[count.next].prev : idle_tail) = count.prev;
+        count.idle = false;
+        count.prev = count.next = UINT32_MAX;
+    }
+    
+    uint32_t index = 0;
+    uint32_t generation = 0;
+    
+    TextureRef() = default;
+    TextureRef(uint32_t index, uint32_t generation) : index(index), generation(generation) { retain(); }
+    TextureRef(const TextureRef& other) : index(other.index), generation(other.generation) { retain(); }
+    TextureRef(TextureRef&& other) noexcept : index(other.index), generation(other.generation) {
+        other.generation = 0;
+    }
+    TextureRef& operator=(TextureRef other) noexcept {
+        std::swap(index, other.index);
+        std::swap(generation, other.generation);
+        return *this;
+    }
+    ~TextureRef() { release(); }
+    
+    bool valid() const { return index < counts.size() && counts[index].generation == generation; }
+    void retain() { if (valid() && counts[index].refs++ == 0) unlink_idle(index); }
+    void release() { if (valid() && --counts[index].refs == 0) link_idle(index); }
+};
+
+std::vector<TextureRef::Count> TextureRef::counts;
+uint32_t TextureRef::idle_head = UINT32_MAX;
+uint32_t TextureRef::idle_tail = UINT32_MAX;
+
 struct Sprite {
     HMM_Vec4 color;
     HMM_Vec2 size;
-    sg_image texture;
+    TextureRef texture;
     
-    Sprite() : color({1,1,1,1}), size({100,100}), texture{SG_INVALID_ID} {}
+    Sprite() : color({1,1,1,1}), size({100,100}) {}
 };
 
 struct Rigidbody {
@@ -85,10 +174,40 @@ struct Script {
     std::string path;
     sol::table instance; // Lua table instance
     sol::environment env; // Script environment with entity_id
+    sol::protected_function init_fn; // Callbacks resolved once at load
+    sol::protected_function update_fn;
+    sol::protected_function run_fn; // Optional coroutine body, see ScriptScheduler
+    sol::protected_function on_spawn_fn; // Called each time a prefab instance is (re)spawned
+    uint32_t coroutine; // Scheduler slot running run_fn
+    uint32_t coroutine_generation;
+    uint32_t profile_slot; // ScriptProfiler entry for this path
+    uint32_t update_interval; // Steps between update calls, from the script table
+    float update_rate; // Update frequency in Hz; 0 uses update_interval
+    std::vector<std::pair<float, uint32_t>> update_lod; // (max camera distance, interval), nearest first
+    uint32_t tick_phase; // Offset that spreads scripts with the same interval across steps
+    uint64_t last_tick; // Step of the last update call
+    int shard; // ScriptShards VM running this script, -1 for the main state
+    uint32_t instance_serial; // Unique per load; stale event subscriptions don't match
     bool loaded;
+    bool disabled; // Stopped by ScriptWatchdog until the script is reloaded
+    bool spawned; // on_spawn is due before the next update
+    bool error_reported; // Only the first runtime error is logged
     EntityId entity; // Reference to owner entity
     
-    Script() : path(""), loaded(false), entity(NULL_ENTITY) {}
+    Script() : path(""), coroutine(UINT32_MAX), coroutine_generation(0), profile_slot(0), update_interval(1),
+               update_rate(0.0f), tick_phase(0), last_tick(0), shard(-1),
+               instance_serial(0), loaded(false), disabled(false), spawned(false), error_reported(false), entity(NULL_ENTITY) {}
+};
+
+// Name and Tag are indexed by the Registry; change them through set_name / set_tag
+struct Name {
+    std::string value;
+    uint32_t slot = 0; // Position in the Registry's index bucket for value
+};
+
+struct Tag {
+    std::string value;
+    uint32_t slot = 0;
 };
 
 struct Camera {
@@ -98,50 +217,63 @@ struct Camera {
     Camera() : zoom(1.0f), offset({0,0}) {}
 };
 
-// Sparse set component storage
+// Sparse set component storage: sparse maps entity id -> dense index,
+// the dense arrays are packed so pools can be walked and bulk-filled
 template<typename T>
 struct ComponentArray {
+    static constexpr uint32_t NONE = UINT32_MAX;
+    
     std::vector<EntityId> entities;
     std::vector<T> components;
-    std::unordered_map<EntityId, size_t> entity_to_index;
+    std::vector<uint32_t> sparse;
+    
+    uint32_t index_of(EntityId e) const {
+        if (e.id >= sparse.size()) return NONE;
+        uint32_t index = sparse[e.id];
+        return (index != NONE && entities[index] == e) ? index : NONE;
+    }
     
     bool has(EntityId e) const {
-        return entity_to_index.find(e) != entity_to_index.end();
+        return index_of(e) != NONE;
     }
     
     T* get(EntityId e) {
-        auto it = entity_to_index.find(e);
-        if (it == entity_to_index.end()) return nullptr;
-        return &components[it->second];
+        uint32_t index = index_of(e);
+        return index == NONE ? nullptr : &components[index];
     }
     
     T& add(EntityId e, const T& component) {
         if (has(e)) {
             return *get(e);
         }
-        size_t index = entities.size();
+        if (e.id >= sparse.size()) sparse.resize((size_t)e.id + 1, NONE);
+        sparse[e.id] = (uint32_t)entities.size();
         entities.push_back(e);
         components.push_back(component);
-        entity_to_index[e] = index;
         return components.back();
     }
     
+    // Dense room for count components, sparse room for entity ids below id_limit
+    void reserve(size_t count, size_t id_limit = 0) {
+        entities.reserve(count);
+        components.reserve(count);
+        sparse.reserve(id_limit);
+    }
+    
     void remove(EntityId e) {
-        auto it = entity_to_index.find(e);
-        if (it == entity_to_index.end()) return;
-        
-        size_t index = it->second;
-        size_t last = entities.size() - 1;
+        uint32_t index = index_of(e);
+        if (index == NONE) return;
         
+        uint32_t last = (uint32_t)entities.size() - 1;
         if (index != last) {
             entities[index] = entities[last];
-            components[index] = components[last];
-            entity_to_index[entities[index]] = index;
+            components[index] = std::move(components[last]);
+            sparse[entities[index].id] = index;
         }
         
         entities.pop_back();
         components.pop_back();
-        entity_to_index.erase(e);
+        sparse[e.id] = NONE;
     }
     
     template<typename Fn>
@@ -163,6 +295,12 @@ struct Registry {
     ComponentArray<Rigidbody> rigidbodies;
     ComponentArray<Script> scripts;
     ComponentArray<Camera> cameras;
+    ComponentArray<Name> names;
+    ComponentArray<Tag> tags;
+    
+    // Entities by name and by tag, kept in sync with the components above
+    std::unordered_map<std::string, std::vector<EntityId>> name_index;
+    std::unordered_map<std::string, std::vector<EntityId>> tag_index;
     
     EntityId create() {
         EntityId e;
@@ -178,6 +316,27 @@ struct Registry {
         return e;
     }
     
+    // Room for count more entities with a transform and sprite, so bulk loads grow every array once
+    void reserve(size_t count) {
+        size_t id_limit = generations.size() + count;
+        generations.reserve(id_limit);
+        transforms.reserve(transforms.entities.size() + count, id_limit);
+        sprites.reserve(sprites.entities.size() + count, id_limit);
+        rigidbodies.reserve(rigidbodies.entities.size(), id_limit);
+        scripts.reserve(scripts.entities.size(), id_limit);
+    }
+    
+    // Brings a destroyed entity back under its old id and generation (editor undo).
+    // Fails if the id has been reused since.
+    bool revive(EntityId e) {
+        if (e.id >= generations.size()) return false;
+        auto it = std::find(free_ids.begin(), free_ids.end(), e.id);
+        if (it == free_ids.end()) return false;
+        free_ids.erase(it);
+        generations[e.id] = e.generation;
+        return true;
+    }
+    
     void destroy(EntityId e) {
         if (e.id >= generations.size() || generations[e.id] != e.generation) {
             return; // Invalid entity
@@ -189,6 +348,8 @@ struct Registry {
         rigidbodies.remove(e);
         scripts.remove(e);
         cameras.remove(e);
+        set_name(e, "");
+        set_tag(e, "");
         
         // Increment generation and add to free list
         generations[e.id]++;
@@ -198,14 +359,110 @@ struct Registry {
     bool valid(EntityId e) const {
         return e.id < generations.size() && generations[e.id] == e.generation;
     }
+    
+    // An empty string removes the component
+    void set_name(EntityId e, const std::string& name) {
+        set_indexed(names, name_index, e, name);
+    }
+    
+    void set_tag(EntityId e, const std::string& tag) {
+        set_indexed(tags, tag_index, e, tag);
+    }
+    
+    // An entity with this name, or NULL_ENTITY; names are meant to be unique
+    EntityId find_by_name(const std::string& name) const {
+        auto it = name_index.find(name);
+        return it == name_index.end() ? NULL_ENTITY : it->second.front();
+    }
+    
+    const std::vector<EntityId>* with_tag(const std::string& tag) const {
+        auto it = tag_index.find(tag);
+        return it == tag_index.end() ? nullptr : &it->second;
+    }
+    
+    template<typename T>
+    static void set_indexed(ComponentArray<T>& array, std::unordered_map<std::string, std::vector<EntityId>>& index,
+                            EntityId e, const std::string& value) {
+        T* current = array.get(e);
+        if (current) {
+            if (current->value == value) return;
+            // Swap-remove from the bucket and move the last entity into the gap, so
+            // renaming or destroying many entities sharing a value stays linear
+            auto it = index.find(current->value);
+            if (it != index.end() && current->slot < it->second.size() && it->second[current->slot] == e) {
+                std::vector<EntityId>& bucket = it->second;
+                bucket[current->slot] = bucket.back();
+                array.get(bucket[current->slot])->slot = current->slot;
+                bucket.pop_back();
+                if (bucket.empty()) index.erase(it);
+            }
+            array.remove(e);
+        }
+        if (!value.empty()) {
+            std::vector<EntityId>& bucket = index[value];
+            array.add(e, T{value, (uint32_t)bucket.size()});
+            bucket.push_back(e);
+        }
+    }
 };
 
 // ============================================================================
 // Systems
 // ============================================================================
 
+static void log_console(const std::string& msg);
+
+// FNV-1a, used for content keys and state checksums
+static uint64_t hash_bytes(const void* data, size_t size, uint64_t h = 14695981039346656037ull) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
 // Physics System: sync Rigidbody <-> Transform
 struct PhysicsSystem {
+    // Box body sized from the sprite. The owning entity is packed into the body's
+    // user data so contact events can be mapped back to entities.
+    static void create_body(Registry& reg, b2WorldId world, EntityId e, Rigidbody& rb) {
+        b2BodyDef bodyDef = b2DefaultBodyDef();
+        Transform* t = reg.transforms.get(e);
+        if (t) {
+            bodyDef.position = b2Vec2{t->position.X, t->position.Y};
+            bodyDef.rotation = b2MakeRot(t->rotation);
+        }
+        bodyDef.type = rb.body_type;
+        bodyDef.fixedRotation = rb.fixed_rotation;
+        bodyDef.userData = (void*)(uintptr_t)(((uint64_t)e.generation << 32) | e.id);
+        rb.body = b2CreateBody(world, &bodyDef);
+        
+        // Add a box shape
+        Sprite* sprite = reg.sprites.get(e);
+        float hw = sprite ? sprite->size.X * 0.5f : 50.0f;
+        float hh = sprite ? sprite->size.Y * 0.5f : 50.0f;
+        b2Polygon box = b2MakeBox(hw, hh);
+        b2ShapeDef shapeDef = b2DefaultShapeDef();
+        shapeDef.density = rb.density;
+        shapeDef.material.friction = rb.friction;
+        shapeDef.material.restitution = rb.restitution;
+        shapeDef.enableContactEvents = true;
+        b2CreatePolygonShape(rb.body, &shapeDef, &box);
+    }
+    
+    // Destroys the entity together with its physics body
+    static void destroy_entity(Registry& reg, EntityId e) {
+        Rigidbody* rb = reg.rigidbodies.get(e);
+        if (rb && b2Body_IsValid(rb->body)) b2DestroyBody(rb->body);
+        reg.destroy(e);
+    }
+    
+    static EntityId body_entity(b2BodyId body) {
+        uint64_t packed = (uint64_t)(uintptr_t)b2Body_GetUserData(body);
+        return EntityId{(uint32_t)packed, (uint32_t)(packed >> 32)};
+    }
+    
     static void sync_to_physics(Registry& reg, b2WorldId world) {
         reg.rigidbodies.each([&](EntityId e, Rigidbody& rb) {
             if (b2Body_IsValid(rb.body)) {
@@ -234,311 +491,4698 @@ struct PhysicsSystem {
 
 // Scene Serialization
 struct SceneSerializer {
+    // Binary scenes (.3kscene): a header, then one chunk per component pool. Records
+    // have a fixed size and refer to entities by their index in the file, so loading
+    // is one read, then appends that grow each pool's dense arrays once per batch.
+    // Names and tags still go through the Registry's index one at a time.
+    static constexpr char BINARY_MAGIC[4] = {'3', 'K', 'S', 'C'};
+    static constexpr uint32_t BINARY_VERSION = 1;
+    
+    struct BinaryHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t entity_count;
+        uint32_t chunk_count;
+    };
+    
+    struct BinaryChunk {
+        char tag[4];    // XFRM, SPRT, RGBD, SCRP, NAME, TAGS or STRS; unknown tags are skipped
+        uint32_t count; // Records in the chunk, bytes for STRS
+        uint64_t size;  // Payload bytes following this header, a multiple of 8
+    };
+    
+    struct TransformRecord { uint32_t entity; float x, y, rotation, scale_x, scale_y; };
+    struct SpriteRecord { uint32_t entity; float r, g, b, a, width, height; };
+    struct RigidbodyRecord { uint32_t entity; int32_t body_type; uint32_t fixed_rotation; float density, friction, restitution; };
+    struct StringRecord { uint32_t entity; uint32_t offset; uint32_t length; }; // Slice of the STRS chunk
+    
+    struct ChunkView {
+        const char* data = nullptr;
+        uint32_t count = 0;
+        uint64_t size = 0;
+    };
+    
+    static bool is_binary_path(const char* path) {
+        size_t length = strlen(path);
+        return length >= 8 && strcmp(path + length - 8, ".3kscene") == 0;
+    }
+    
+    // Plain copy of everything a scene file stores, taken on the main thread so the
+    // file can be encoded and written on another. Entities are numbered by their
+    // position in the transform pool and every record array is in entity order; like
+    // the text format, components of entities without a transform are not saved.
+    struct Snapshot {
+        std::vector<EntityId> entities;
+        std::vector<TransformRecord> transforms;
+        std::vector<SpriteRecord> sprites;
+        std::vector<RigidbodyRecord> rigidbodies;
+        std::vector<StringRecord> scripts, names, tags;
+        std::string strings;
+    };
+    
+    static void snapshot(Registry& reg, Snapshot& snap) {
+        std::unordered_map<std::string, uint32_t> string_offsets; // Script paths repeat a lot
+        auto add_string = [&](std::vector<StringRecord>& records, uint32_t entity, const std::string& value) {
+            auto [it, inserted] = string_offsets.try_emplace(value, (uint32_t)snap.strings.size());
+            if (inserted) snap.strings += value;
+            records.push_back({entity, it->second, (uint32_t)value.size()});
+        };
+        
+        size_t count = reg.transforms.entities.size();
+        snap.entities = reg.transforms.entities;
+        snap.transforms.reserve(count);
+        snap.sprites.reserve(reg.sprites.entities.size());
+        snap.rigidbodies.reserve(reg.rigidbodies.entities.size());
+        for (uint32_t i = 0; i < (uint32_t)count; ++i) {
+            EntityId e = reg.transforms.entities[i];
+            const Transform& t = reg.transforms.components[i];
+            snap.transforms.push_back({i, t.position.X, t.position.Y, t.rotation, t.scale.X, t.scale.Y});
+            
+            if (Sprite* sprite = reg.sprites.get(e)) {
+                snap.sprites.push_back({i, sprite->color.X, sprite->color.Y, sprite->color.Z, sprite->color.W,
+                                        sprite->size.X, sprite->size.Y});
+            }
+            if (Rigidbody* rb = reg.rigidbodies.get(e)) {
+                snap.rigidbodies.push_back({i, (int32_t)rb->body_type, rb->fixed_rotation ? 1u : 0u,
+                                            rb->density, rb->friction, rb->restitution});
+            }
+            Script* script = reg.scripts.get(e);
+            if (script && !script->path.empty()) add_string(snap.scripts, i, script->path);
+            if (Name* name = reg.names.get(e)) add_string(snap.names, i, name->value);
+            if (Tag* tag = reg.tags.get(e)) add_string(snap.tags, i, tag->value);
+        }
+    }
+    
     static bool save(const char* path, Registry& reg) {
-        std::ofstream file(path);
-        if (!file.is_open()) return false;
+        Snapshot snap;
+        snapshot(reg, snap);
+        return write_file(path, is_binary_path(path) ? encode_binary(snap) : encode_text(snap));
+    }
+    
+    static void write(std::ostream& file, Registry& reg) {
+        Snapshot snap;
+        snapshot(reg, snap);
+        std::string out = encode_text(snap);
+        file.write(out.data(), (std::streamsize)out.size());
+    }
+    
+    // Writes next to the target and renames over it, so a crash mid-write leaves the
+    // previous file intact. The temp name carries the thread id: texture decode workers
+    // that miss on the same content hash write the same cache file at once.
+    static bool write_file(const char* path, const std::string& data) {
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%zx.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        std::string temp_path = std::string(path) + suffix;
+        {
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) return false;
+            file.write(data.data(), (std::streamsize)data.size());
+            file.flush();
+            if (!file.good()) {
+                file.close();
+                std::remove(temp_path.c_str());
+                return false;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(temp_path, path, ec);
+        if (ec) {
+            std::remove(temp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+    
+    // Text is built in one buffer with to_chars (shortest form that reads back exactly)
+    static std::string encode_text(const Snapshot& snap) {
+        std::string out;
+        out.reserve(snap.entities.size() * 96);
+        char buf[32];
+        out += "# Scene File\nentities ";
+        out.append(buf, std::to_chars(buf, buf + sizeof(buf), snap.entities.size()).ptr);
+        out += '\n';
         
-        file << "# Scene File\n";
+        auto put = [&](auto value) {
+            out += ' ';
+            out.append(buf, std::to_chars(buf, buf + sizeof(buf), value).ptr);
+        };
+        auto put_string = [&](const char* key, const StringRecord& r) {
+            out += key;
+            out.append(snap.strings, r.offset, r.length);
+            out += '\n';
+        };
         
-        reg.transforms.each([&](EntityId e, Transform& t) {
-            file << "entity " << e.id << " " << e.generation << "\n";
-            file << "  transform " << t.position.X << " " << t.position.Y << " " 
-                 << t.rotation << " " << t.scale.X << " " << t.scale.Y << "\n";
+        size_t sprite = 0, rb = 0, script = 0, name = 0, tag = 0;
+        for (uint32_t i = 0; i < (uint32_t)snap.entities.size(); ++i) {
+            const TransformRecord& t = snap.transforms[i];
+            out += "entity";
+            put(snap.entities[i].id);
+            put(snap.entities[i].generation);
+            out += "\n  transform";
+            put(t.x); put(t.y); put(t.rotation); put(t.scale_x); put(t.scale_y);
+            out += '\n';
             
-            Sprite* sprite = reg.sprites.get(e);
-            if (sprite) {
-                file << "  sprite " << sprite->color.X << " " << sprite->color.Y << " " 
-                     << sprite->color.Z << " " << sprite->color.W << " "
-                     << sprite->size.X << " " << sprite->size.Y << "\n";
+            if (sprite < snap.sprites.size() && snap.sprites[sprite].entity == i) {
+                const SpriteRecord& s = snap.sprites[sprite++];
+                out += "  sprite";
+                put(s.r); put(s.g); put(s.b); put(s.a); put(s.width); put(s.height);
+                out += '\n';
             }
-            
-            Rigidbody* rb = reg.rigidbodies.get(e);
-            if (rb) {
-                file << "  rigidbody " << (int)rb->body_type << " " 
-                     << (rb->fixed_rotation ? 1 : 0) << " "
-                     << rb->density << " " << rb->friction << " " << rb->restitution << "\n";
+            if (rb < snap.rigidbodies.size() && snap.rigidbodies[rb].entity == i) {
+                const RigidbodyRecord& r = snap.rigidbodies[rb++];
+                out += "  rigidbody";
+                put(r.body_type); put(r.fixed_rotation);
+                put(r.density); put(r.friction); put(r.restitution);
+                out += '\n';
             }
-            
-            Script* script = reg.scripts.get(e);
-            if (script && !script->path.empty()) {
-                file << "  script " << script->path << "\n";
+            if (script < snap.scripts.size() && snap.scripts[script].entity == i) {
+                put_string("  script ", snap.scripts[script++]);
             }
-        });
+            if (name < snap.names.size() && snap.names[name].entity == i) {
+                put_string("  name ", snap.names[name++]);
+            }
+            if (tag < snap.tags.size() && snap.tags[tag].entity == i) {
+                put_string("  tag ", snap.tags[tag++]);
+            }
+        }
+        return out;
+    }
+    
+    static std::string encode_binary(const Snapshot& snap) {
+        std::string out;
+        BinaryHeader header;
+        memcpy(header.magic, BINARY_MAGIC, 4);
+        header.version = BINARY_VERSION;
+        header.entity_count = (uint32_t)snap.entities.size();
+        header.chunk_count = 7;
+        out.append((const char*)&header, sizeof(header));
         
-        file.close();
-        return true;
+        auto add_chunk = [&](const char* tag, uint32_t count, const void* data, size_t size) {
+            BinaryChunk chunk;
+            memcpy(chunk.tag, tag, 4);
+            chunk.count = count;
+            chunk.size = (size + 7) & ~(uint64_t)7;
+            out.append((const char*)&chunk, sizeof(chunk));
+            out.append((const char*)data, size);
+            out.append((size_t)(chunk.size - size), '\0');
+        };
+        add_chunk("STRS", (uint32_t)snap.strings.size(), snap.strings.data(), snap.strings.size());
+        add_chunk("XFRM", (uint32_t)snap.transforms.size(), snap.transforms.data(), snap.transforms.size() * sizeof(TransformRecord));
+        add_chunk("SPRT", (uint32_t)snap.sprites.size(), snap.sprites.data(), snap.sprites.size() * sizeof(SpriteRecord));
+        add_chunk("RGBD", (uint32_t)snap.rigidbodies.size(), snap.rigidbodies.data(), snap.rigidbodies.size() * sizeof(RigidbodyRecord));
+        add_chunk("SCRP", (uint32_t)snap.scripts.size(), snap.scripts.data(), snap.scripts.size() * sizeof(StringRecord));
+        add_chunk("NAME", (uint32_t)snap.names.size(), snap.names.data(), snap.names.size() * sizeof(StringRecord));
+        add_chunk("TAGS", (uint32_t)snap.tags.size(), snap.tags.data(), snap.tags.size() * sizeof(StringRecord));
+        return out;
     }
     
-    static bool load(const char* path, Registry& reg, b2WorldId world) {
-        std::string content;
+    // Resumable load: the file contents and where instantiation stopped, so a scene can
+    // be loaded a slice at a time (see SceneStreamer). Text resumes at the next line,
+    // binary at the next record of the current chunk.
+    struct LoadCursor {
+        std::string storage; // File contents when the cursor owns them
+        std::string_view data;
+        bool binary = false;
+        bool done = false;
+        bool failed = false;
         
-        // Try PhysFS first
+        // Text
+        size_t offset = 0;
+        uint32_t line_number = 0;
+        EntityId current_entity = NULL_ENTITY;
+        
+        // Binary: chunks in load order, STRS first; stage 0 needs no instantiation
+        ChunkView chunks[7];
+        std::vector<EntityId> ids;
+        uint32_t stage = 1;
+        uint32_t record = 0;
+        
+        // Fraction of the file instantiated so far
+        float progress() const {
+            if (done || data.empty()) return 1.0f;
+            size_t position = offset;
+            if (binary) {
+                position = stage < 7 ? (size_t)(chunks[stage].data - data.data()) + (size_t)record * RECORD_SIZES[stage]
+                                     : data.size();
+            }
+            return (float)((double)position / (double)data.size());
+        }
+    };
+    
+    static constexpr const char* CHUNK_TAGS[7] = {"STRS", "XFRM", "SPRT", "RGBD", "SCRP", "NAME", "TAGS"};
+    static constexpr size_t RECORD_SIZES[7] = {1, sizeof(TransformRecord), sizeof(SpriteRecord), sizeof(RigidbodyRecord),
+                                               sizeof(StringRecord), sizeof(StringRecord), sizeof(StringRecord)};
+    
+    // Whole file in one read: PhysFS first, std::ifstream for absolute paths
+    static bool read_file(const char* path, std::string& content) {
+        content.clear();
         PHYSFS_File* pfile = PHYSFS_openRead(path);
         if (pfile) {
             PHYSFS_sint64 filesize = PHYSFS_fileLength(pfile);
             if (filesize > 0) {
-                std::vector<char> buffer(filesize + 1);
-                PHYSFS_readBytes(pfile, buffer.data(), filesize);
-                buffer[filesize] = '\0';
-                content = buffer.data();
+                content.resize((size_t)filesize);
+                PHYSFS_sint64 read = PHYSFS_readBytes(pfile, content.data(), (PHYSFS_uint64)filesize);
+                content.resize((size_t)std::max<PHYSFS_sint64>(read, 0));
             }
             PHYSFS_close(pfile);
         } else {
-            // Fallback to std::ifstream for absolute paths
-            std::ifstream file(path);
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
             if (!file.is_open()) return false;
             
-            std::stringstream buffer;
-            buffer << file.rdbuf();
-            content = buffer.str();
-            file.close();
+            content.resize((size_t)std::max<std::streamoff>(file.tellg(), 0));
+            file.seekg(0);
+            file.read(content.data(), (std::streamsize)content.size());
+            content.resize((size_t)std::max<std::streamsize>(file.gcount(), 0));
         }
+        return !content.empty();
+    }
+    
+    static bool load(const char* path, Registry& reg, b2WorldId world) {
+        std::string content;
+        if (!read_file(path, content)) return false;
+        return load_from_memory(content, reg, world);
+    }
+    
+    // Text or binary, told apart by the magic
+    static bool load_from_memory(std::string_view content, Registry& reg, b2WorldId world) {
+        LoadCursor cursor;
+        cursor.data = content;
+        if (!begin_load(cursor, reg)) return false;
+        load_step(cursor, reg, world, std::chrono::steady_clock::time_point::max());
+        if (cursor.failed) {
+            // Binary entities were all created up front; don't leave a partial scene behind
+            for (EntityId e : cursor.ids) PhysicsSystem::destroy_entity(reg, e);
+            return false;
+        }
+        return true;
+    }
+    
+    // Detects the format and, for binary scenes, validates the chunk table and creates
+    // every entity up front so records can refer to them by index
+    static bool begin_load(LoadCursor& cursor, Registry& reg) {
+        const char* data = cursor.data.data();
+        size_t size = cursor.data.size();
+        cursor.binary = size >= 4 && memcmp(data, BINARY_MAGIC, 4) == 0;
+        if (!cursor.binary) return true;
         
-        if (content.empty()) return false;
-        
-        std::istringstream iss(content);
-        std::string line;
-        EntityId current_entity = NULL_ENTITY;
+        BinaryHeader header;
+        if (size < sizeof(header)) return false;
+        memcpy(&header, data, sizeof(header));
+        if (header.version != BINARY_VERSION) return false;
         
-        while (std::getline(iss, line)) {
-            if (line.empty() || line[0] == '#') continue;
+        size_t offset = sizeof(header);
+        for (uint32_t i = 0; i < header.chunk_count; ++i) {
+            BinaryChunk chunk;
+            if (size - offset < sizeof(chunk)) return false;
+            memcpy(&chunk, data + offset, sizeof(chunk));
+            offset += sizeof(chunk);
+            if (chunk.size > size - offset) return false;
             
-            std::istringstream lss(line);
-            std::string cmd;
-            lss >> cmd;
-            
-            if (cmd == "entity") {
-                current_entity = reg.create();
-            } else if (cmd == "transform" && current_entity != NULL_ENTITY) {
-                Transform t;
-                lss >> t.position.X >> t.position.Y >> t.rotation >> t.scale.X >> t.scale.Y;
-                reg.transforms.add(current_entity, t);
-            } else if (cmd == "sprite" && current_entity != NULL_ENTITY) {
-                Sprite s;
-                lss >> s.color.X >> s.color.Y >> s.color.Z >> s.color.W >> s.size.X >> s.size.Y;
-                reg.sprites.add(current_entity, s);
-            } else if (cmd == "rigidbody" && current_entity != NULL_ENTITY) {
-                Rigidbody rb;
-                int body_type_int, fixed_rot_int;
-                lss >> body_type_int >> fixed_rot_int >> rb.density >> rb.friction >> rb.restitution;
-                rb.body_type = (b2BodyType)body_type_int;
-                rb.fixed_rotation = (fixed_rot_int != 0);
-                
-                // Create Box2D body
-                b2BodyDef bodyDef = b2DefaultBodyDef();
-                Transform* t = reg.transforms.get(current_entity);
-                if (t) {
-                    bodyDef.position = b2Vec2{t->position.X, t->position.Y};
-                    bodyDef.rotation = b2MakeRot(t->rotation);
-                }
-                bodyDef.type = rb.body_type;
-                bodyDef.fixedRotation = rb.fixed_rotation;
-                rb.body = b2CreateBody(world, &bodyDef);
-                
-                // Add a box shape
-                Sprite* sprite = reg.sprites.get(current_entity);
-                float hw = sprite ? sprite->size.X * 0.5f : 50.0f;
-                float hh = sprite ? sprite->size.Y * 0.5f : 50.0f;
-                b2Polygon box = b2MakeBox(hw, hh);
-                b2ShapeDef shapeDef = b2DefaultShapeDef();
-                shapeDef.density = rb.density;
-                shapeDef.material.friction = rb.friction;
-                shapeDef.material.restitution = rb.restitution;
-                b2CreatePolygonShape(rb.body, &shapeDef, &box);
-                
-                reg.rigidbodies.add(current_entity, rb);
-            } else if (cmd == "script" && current_entity != NULL_ENTITY) {
-                Script sc;
-                lss >> sc.path;
-                reg.scripts.add(current_entity, sc);
+            // Unknown tags are skipped
+            for (int stage = 0; stage < 7; ++stage) {
+                if (memcmp(chunk.tag, CHUNK_TAGS[stage], 4) != 0) continue;
+                if ((uint64_t)chunk.count * RECORD_SIZES[stage] > chunk.size) return false;
+                cursor.chunks[stage] = ChunkView{data + offset, chunk.count, chunk.size};
             }
+            offset += (size_t)chunk.size;
         }
+        // Missing chunks are empty views at the end of the file, which keeps progress() monotonic
+        for (ChunkView& chunk : cursor.chunks) {
+            if (!chunk.data) chunk.data = data + size;
+        }
+        
+        // Every saved entity has exactly one transform record, and the chunk table
+        // check above already bounds that count by the file size
+        if (header.entity_count != cursor.chunks[1].count) return false;
         
+        reg.reserve(header.entity_count);
+        size_t id_limit = reg.generations.size() + header.entity_count;
+        reg.rigidbodies.reserve(reg.rigidbodies.entities.size() + cursor.chunks[3].count, id_limit);
+        reg.scripts.reserve(reg.scripts.entities.size() + cursor.chunks[4].count, id_limit);
+        cursor.ids.resize(header.entity_count);
+        for (EntityId& e : cursor.ids) e = reg.create();
         return true;
     }
-};
-
-// Input System
-struct InputSystem {
-    static bool keys[SAPP_MAX_KEYCODES];
-    static bool keys_pressed[SAPP_MAX_KEYCODES];
-    static HMM_Vec2 mouse_pos;
-    static bool mouse_buttons[3];
     
-    static void reset() {
-        for (int i = 0; i < SAPP_MAX_KEYCODES; ++i) {
-            keys_pressed[i] = false;
+    // Instantiates until the deadline passes, at least one batch per call. Sets
+    // cursor.done at the end of the file, cursor.failed on malformed input.
+    static void load_step(LoadCursor& cursor, Registry& reg, b2WorldId world,
+                          std::chrono::steady_clock::time_point deadline) {
+        if (cursor.done || cursor.failed) return;
+        if (cursor.binary) {
+            load_binary_step(cursor, reg, world, deadline);
+        } else {
+            load_text_step(cursor, reg, world, deadline);
         }
     }
     
-    static bool get_key(sapp_keycode key) { return keys[key]; }
-    static bool get_key_down(sapp_keycode key) { return keys_pressed[key]; }
-    static HMM_Vec2 get_mouse_position() { return mouse_pos; }
-    static bool get_mouse_button(int button) { return button < 3 ? mouse_buttons[button] : false; }
-};
-
-bool InputSystem::keys[SAPP_MAX_KEYCODES] = {};
-bool InputSystem::keys_pressed[SAPP_MAX_KEYCODES] = {};
-HMM_Vec2 InputSystem::mouse_pos = {0, 0};
-bool InputSystem::mouse_buttons[3] = {};
-
-// Script System
-struct ScriptSystem {
-    static void load_script(Script& script, sol::state* lua, EntityId e, Registry& reg) {
-        if (script.path.empty() || script.loaded) return;
-        script.entity = e;
+    static constexpr uint32_t LOAD_BATCH = 256; // Lines or records between deadline checks
+    
+    // Entities destroyed while their scene streams in (editor delete, cell unload) are
+    // skipped, so their remaining records don't land on dead ids
+    template<typename Record, typename Fn>
+    static bool read_records(const Registry& reg, const ChunkView& chunk, const std::vector<EntityId>& ids,
+                             uint32_t first, uint32_t last, Fn&& fn) {
+        for (uint32_t i = first; i < last; ++i) {
+            Record record;
+            memcpy(&record, chunk.data + (size_t)i * sizeof(Record), sizeof(Record));
+            if (record.entity >= ids.size()) return false;
+            if (!reg.valid(ids[record.entity])) continue;
+            if (!fn(ids[record.entity], record)) return false;
+        }
+        return true;
+    }
+    
+    // Appends the components of records [first, last) to a pool's dense arrays, which
+    // grow once per batch instead of once per record. A record naming an entity that
+    // already has the component is skipped, as add() would; fill returns false to
+    // reject a record.
+    template<typename Record, typename T, typename Fn>
+    static bool append_records(const Registry& reg, const ChunkView& chunk, const std::vector<EntityId>& ids,
+                               uint32_t first, uint32_t last, ComponentArray<T>& array, Fn&& fill) {
+        size_t size = array.entities.size();
+        array.entities.resize(size + (last - first));
+        array.components.resize(size + (last - first));
+        bool ok = true;
+        for (uint32_t i = first; i < last; ++i) {
+            Record record;
+            memcpy(&record, chunk.data + (size_t)i * sizeof(Record), sizeof(Record));
+            if (record.entity >= ids.size()) {
+                ok = false;
+                break;
+            }
+            EntityId e = ids[record.entity];
+            if (!reg.valid(e)) continue;
+            if (e.id >= array.sparse.size()) array.sparse.resize((size_t)e.id + 1, ComponentArray<T>::NONE);
+            uint32_t& slot = array.sparse[e.id];
+            if (slot < size && array.entities[slot] == e) continue;
+            slot = (uint32_t)size;
+            array.entities[size] = e;
+            if (!fill(e, array.components[size], record)) {
+                slot = ComponentArray<T>::NONE;
+                ok = false;
+                break;
+            }
+            size++;
+        }
+        array.entities.resize(size);
+        array.components.resize(size);
+        return ok;
+    }
+    
+    static bool load_records(LoadCursor& cursor, Registry& reg, b2WorldId world, uint32_t first, uint32_t last) {
+        const ChunkView& strs = cursor.chunks[0];
+        const ChunkView& chunk = cursor.chunks[cursor.stage];
+        auto string_at = [&](const StringRecord& r, std::string& out) {
+            if ((uint64_t)r.offset + r.length > strs.count) return false;
+            out.assign(strs.data + r.offset, r.length);
+            return true;
+        };
+        
+        switch (cursor.stage) {
+        case 1:
+            return append_records<TransformRecord>(reg, chunk, cursor.ids, first, last, reg.transforms,
+                                                   [](EntityId, Transform& t, const TransformRecord& r) {
+                t.position = {r.x, r.y};
+                t.rotation = r.rotation;
+                t.scale = {r.scale_x, r.scale_y};
+                return true;
+            });
+        case 2:
+            return append_records<SpriteRecord>(reg, chunk, cursor.ids, first, last, reg.sprites,
+                                                [](EntityId, Sprite& s, const SpriteRecord& r) {
+                s.color = {r.r, r.g, r.b, r.a};
+                s.size = {r.width, r.height};
+                return true;
+            });
+        case 3:
+            return append_records<RigidbodyRecord>(reg, chunk, cursor.ids, first, last, reg.rigidbodies,
+                                                   [&](EntityId e, Rigidbody& rb, const RigidbodyRecord& r) {
+                rb.body_type = (b2BodyType)r.body_type;
+                rb.fixed_rotation = r.fixed_rotation != 0;
+                rb.density = r.density;
+                rb.friction = r.friction;
+                rb.restitution = r.restitution;
+                if (b2World_IsValid(world)) {
+                    PhysicsSystem::create_body(reg, world, e, rb);
+                }
+                return true;
+            });
+        case 4:
+            return append_records<StringRecord>(reg, chunk, cursor.ids, first, last, reg.scripts,
+                                                [&](EntityId, Script& sc, const StringRecord& r) {
+                return string_at(r, sc.path);
+            });
+        default:
+            return read_records<StringRecord>(reg, chunk, cursor.ids, first, last, [&](EntityId e, const StringRecord& r) {
+                std::string value;
+                if (!string_at(r, value)) return false;
+                if (cursor.stage == 5) reg.set_name(e, value);
+                else reg.set_tag(e, value);
+                return true;
+            });
+        }
+    }
+    
+    static void load_binary_step(LoadCursor& cursor, Registry& reg, b2WorldId world,
+                                 std::chrono::steady_clock::time_point deadline) {
+        if (cursor.chunks[0].count > cursor.chunks[0].size) {
+            cursor.failed = true;
+            return;
+        }
+        while (cursor.stage < 7) {
+            const ChunkView& chunk = cursor.chunks[cursor.stage];
+            while (cursor.record < chunk.count) {
+                uint32_t last = std::min(chunk.count, cursor.record + LOAD_BATCH);
+                if (!load_records(cursor, reg, world, cursor.record, last)) {
+                    log_console(std::string("Scene error in chunk ") + CHUNK_TAGS[cursor.stage] +
+                                ", record " + std::to_string(cursor.record) + ": bad entity or string reference");
+                    cursor.failed = true;
+                    return;
+                }
+                cursor.record = last;
+                if (std::chrono::steady_clock::now() >= deadline) return;
+            }
+            cursor.stage++;
+            cursor.record = 0;
+        }
+        cursor.done = true;
+    }
+    
+    // Cursor over one line of scene text; numbers are parsed in place with from_chars
+    struct LineReader {
+        const char* p;
+        const char* end;
         
-        PHYSFS_File* file = PHYSFS_openRead(script.path.c_str());
-        if (!file) return;
+        void skip_spaces() {
+            while (p < end && (*p == ' ' || *p == '\t')) ++p;
+        }
         
-        PHYSFS_sint64 filesize = PHYSFS_fileLength(file);
-        if (filesize <= 0) { PHYSFS_close(file); return; }
+        std::string_view word() {
+            skip_spaces();
+            const char* start = p;
+            while (p < end && *p != ' ' && *p != '\t') ++p;
+            return std::string_view(start, (size_t)(p - start));
+        }
         
-        std::vector<char> buffer(filesize + 1);
-        PHYSFS_readBytes(file, buffer.data(), filesize);
-        buffer[filesize] = '\0';
-        PHYSFS_close(file);
+        template<typename T>
+        bool number(T& out) {
+            skip_spaces();
+            auto [next, ec] = std::from_chars(p, end, out);
+            if (ec != std::errc()) return false;
+            p = next;
+            return true;
+        }
         
-        try {
-            sol::load_result loaded_script = lua->load(buffer.data());
-            if (loaded_script.valid()) {
-                // Create environment for this script with entity_id and generation
-                script.env = sol::environment(*lua, sol::create, lua->globals());
-                script.env["entity_id"] = e.id;
-                script.env["entity_generation"] = e.generation;
-                
-                // Execute script in its own environment
-                sol::protected_function_result result = loaded_script(script.env);
-                if (result.valid()) {
-                    script.instance = result;
-                    script.loaded = true;
-                    
-                    // Set environment for all script functions
-                    sol::optional<sol::function> init_fn = script.instance["init"];
-                    if (init_fn) {
-                        sol::set_environment(script.env, *init_fn);
-                        (*init_fn)();
-                    }
-                    
-                    // Set environment for update function
-                    sol::optional<sol::function> update_fn = script.instance["update"];
-                    if (update_fn) {
-                        sol::set_environment(script.env, *update_fn);
-                    }
-                }
+        template<typename... T>
+        bool numbers(T&... out) {
+            return (number(out) && ...);
+        }
+        
+        // True when only blanks are left
+        bool at_end() {
+            skip_spaces();
+            return p == end;
+        }
+        
+        // Rest of the line without surrounding blanks; may contain spaces
+        std::string_view rest() {
+            skip_spaces();
+            const char* last = end;
+            while (last > p && (last[-1] == ' ' || last[-1] == '\t')) --last;
+            return std::string_view(p, (size_t)(last - p));
+        }
+    };
+    
+    // Malformed lines stop the load and are reported with their line number
+    static void load_text_step(LoadCursor& cursor, Registry& reg, b2WorldId world,
+                               std::chrono::steady_clock::time_point deadline) {
+        const char* end = cursor.data.data() + cursor.data.size();
+        uint32_t lines = 0;
+        
+        while (cursor.offset < cursor.data.size()) {
+            if (++lines == LOAD_BATCH) {
+                if (std::chrono::steady_clock::now() >= deadline) return;
+                lines = 0;
+            }
+            const char* p = cursor.data.data() + cursor.offset;
+            const char* eol = (const char*)memchr(p, '\n', (size_t)(end - p));
+            if (!eol) eol = end;
+            LineReader line{p, (eol > p && eol[-1] == '\r') ? eol - 1 : eol};
+            cursor.offset = (size_t)(eol - cursor.data.data()) + 1;
+            cursor.line_number++;
+            
+            const char* error = load_line(cursor, line, reg, world);
+            if (error) {
+                log_console("Scene error on line " + std::to_string(cursor.line_number) + ": " + error);
+                cursor.failed = true;
+                return;
             }
-        } catch (const std::exception& e) {
-            // Script load failed
         }
+        cursor.offset = cursor.data.size();
+        cursor.done = true;
     }
     
-    static void update_scripts(Registry& reg, sol::state* lua, float dt) {
-        reg.scripts.each([&](EntityId e, Script& sc) {
-            if (!sc.loaded && !sc.path.empty()) {
-                load_script(sc, lua, e, reg);
+    // Returns an error message, or nullptr when the line was applied or skipped
+    static const char* load_line(LoadCursor& cursor, LineReader& line, Registry& reg, b2WorldId world) {
+        std::string_view cmd = line.word();
+        if (cmd.empty() || cmd[0] == '#') return nullptr;
+        
+        EntityId& current_entity = cursor.current_entity;
+        if (cmd == "entity") {
+            current_entity = reg.create();
+            return nullptr;
+        }
+        if (cmd == "entities") {
+            // Count hint written by save(); lets streaming loads grow the pools once.
+            // Capped by the bytes left, since each entity takes at least an "entity\n" line.
+            size_t count;
+            size_t left = cursor.data.size() - std::min(cursor.offset, cursor.data.size());
+            if (line.number(count)) reg.reserve(std::min(count, left / 7));
+            return nullptr;
+        }
+        
+        // Unknown commands are skipped so newer scenes still load
+        bool component = cmd == "transform" || cmd == "sprite" || cmd == "rigidbody" || cmd == "script" ||
+                         cmd == "name" || cmd == "tag";
+        if (!component) return nullptr;
+        if (current_entity == NULL_ENTITY) {
+            return "component before the first entity";
+        }
+        if (!reg.valid(current_entity)) return nullptr; // Deleted while the scene streams in
+        
+        if (cmd == "transform") {
+            Transform t;
+            if (!line.numbers(t.position.X, t.position.Y, t.rotation, t.scale.X, t.scale.Y) || !line.at_end()) {
+                return "expected transform x y rotation scale_x scale_y";
+            }
+            reg.transforms.add(current_entity, t);
+        } else if (cmd == "sprite") {
+            Sprite s;
+            if (!line.numbers(s.color.X, s.color.Y, s.color.Z, s.color.W, s.size.X, s.size.Y) || !line.at_end()) {
+                return "expected sprite r g b a width height";
             }
+            reg.sprites.add(current_entity, s);
+        } else if (cmd == "rigidbody") {
+            Rigidbody rb;
+            int body_type_int, fixed_rot_int;
+            if (!line.numbers(body_type_int, fixed_rot_int, rb.density, rb.friction, rb.restitution) || !line.at_end()) {
+                return "expected rigidbody type fixed_rotation density friction restitution";
+            }
+            rb.body_type = (b2BodyType)body_type_int;
+            rb.fixed_rotation = (fixed_rot_int != 0);
             
-            if (sc.loaded && sc.instance.valid()) {
-                // Update entity_generation in environment before calling update
-                sc.env["entity_generation"] = e.generation;
-                
-                sol::optional<sol::function> update_fn = sc.instance["update"];
-                if (update_fn) {
-                    try {
-                        (*update_fn)(dt);
-                    } catch (const std::exception& ex) {
-                        // Script error
-                    }
-                }
+            // Create Box2D body; templates loaded without a world (prefabs) keep only the settings
+            if (b2World_IsValid(world)) {
+                PhysicsSystem::create_body(reg, world, current_entity, rb);
             }
-        });
+            reg.rigidbodies.add(current_entity, rb);
+        } else if (cmd == "script") {
+            Script sc;
+            sc.path = line.word();
+            if (!line.at_end()) return "expected script path";
+            reg.scripts.add(current_entity, sc);
+        } else if (cmd == "name") {
+            reg.set_name(current_entity, std::string(line.rest()));
+        } else {
+            reg.set_tag(current_entity, std::string(line.rest()));
+        }
+        return nullptr;
     }
 };
 
-// Asset Manager
-struct AssetManager {
-    static std::unordered_map<std::string, sg_image> textures;
+// Scene Streamer: loads a scene into the editor a time slice per frame so large levels
+// stream in without freezing the UI. Anything that needs the whole scene (play, save)
+// calls finish() first.
+struct SceneStreamer {
+    static SceneSerializer::LoadCursor cursor;
+    static std::string path;
+    static bool active;
+    static double elapsed_ms;
     
-    static sg_image load_texture(const char* path) {
-        auto it = textures.find(path);
-        if (it != textures.end()) {
-            return it->second;
+    static bool begin(const char* file_path, Registry& reg) {
+        cancel(reg);
+        cursor = SceneSerializer::LoadCursor();
+        if (!SceneSerializer::read_file(file_path, cursor.storage)) return false;
+        cursor.data = cursor.storage;
+        if (!SceneSerializer::begin_load(cursor, reg)) {
+            cursor = SceneSerializer::LoadCursor();
+            return false;
         }
+        path = file_path;
+        active = true;
+        elapsed_ms = 0.0;
+        return true;
+    }
+    
+    // Instantiates for up to budget_ms (a negative budget runs to the end)
+    static void update(Registry& reg, b2WorldId world, float budget_ms) {
+        if (!active) return;
+        auto t0 = std::chrono::steady_clock::now();
+        auto deadline = budget_ms < 0.0f ? std::chrono::steady_clock::time_point::max()
+                                         : t0 + std::chrono::microseconds((int64_t)(budget_ms * 1000.0f));
+        SceneSerializer::load_step(cursor, reg, world, deadline);
+        elapsed_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
         
-        PHYSFS_File* file = PHYSFS_openRead(path);
-        if (!file) return sg_image{SG_INVALID_ID};
-        
-        PHYSFS_sint64 filesize = PHYSFS_fileLength(file);
-        if (filesize <= 0) { PHYSFS_close(file); return sg_image{SG_INVALID_ID}; }
-        
-        std::vector<uint8_t> buffer(filesize);
-        PHYSFS_readBytes(file, buffer.data(), filesize);
-        PHYSFS_close(file);
-        
-        int width, height, channels;
-        stbi_uc* pixels = stbi_load_from_memory(buffer.data(), (int)filesize, &width, &height, &channels, 4);
-        if (!pixels) return sg_image{SG_INVALID_ID};
+        if (cursor.done || cursor.failed) {
+            char msg[64];
+            snprintf(msg, sizeof(msg), " (%.1f ms)", elapsed_ms);
+            log_console((cursor.failed ? "Scene load failed: " : "Scene loaded: ") + path + msg);
+            if (cursor.failed) {
+                for (EntityId e : cursor.ids) PhysicsSystem::destroy_entity(reg, e);
+            }
+            active = false;
+            cursor = SceneSerializer::LoadCursor();
+        }
+    }
+    
+    static void finish(Registry& reg, b2WorldId world) {
+        update(reg, world, -1.0f);
+    }
+    
+    // Drops the rest of the load; binary entities created up front are released
+    static void cancel(Registry& reg) {
+        if (!active) return;
+        for (EntityId e : cursor.ids) {
+            PhysicsSystem::destroy_entity(reg, e);
+        }
+        active = false;
+        cursor = SceneSerializer::LoadCursor();
+    }
+    
+    static float progress() {
+        return cursor.progress();
+    }
+};
+
+SceneSerializer::LoadCursor SceneStreamer::cursor;
+std::string SceneStreamer::path;
+bool SceneStreamer::active = false;
+double SceneStreamer::elapsed_ms = 0.0;
+
+// Scene Saver: encodes and writes scene snapshots on a background thread, so the frame
+// only pays for SceneSerializer::snapshot. Results are logged from poll() on the main
+// thread; wait() blocks until every queued save is on disk.
+struct SceneSaver {
+    struct Job {
+        std::string path;
+        SceneSerializer::Snapshot snapshot;
+        bool announce; // Log success too, not just failures
+    };
+    
+    struct Result {
+        std::string path;
+        bool ok;
+        bool announce;
+        double ms;
+    };
+    
+    static std::thread worker;
+    static std::mutex mutex;
+    static std::condition_variable wake;
+    static std::condition_variable idle;
+    static std::deque<Job> jobs;
+    static std::vector<Result> results;
+    static bool busy;
+    static bool stopping;
+    
+    static void save(const std::string& path, Registry& reg, bool announce) {
+        Job job{path, {}, announce};
+        SceneSerializer::snapshot(reg, job.snapshot);
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!worker.joinable()) {
+            stopping = false;
+            worker = std::thread(run);
+        }
+        // A newer snapshot of the same file replaces one that hasn't started yet
+        for (Job& pending : jobs) {
+            if (pending.path == path) {
+                pending = std::move(job);
+                return;
+            }
+        }
+        jobs.push_back(std::move(job));
+        wake.notify_one();
+    }
+    
+    static void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) return; // stopping
+            
+            Job job = std::move(jobs.front());
+            jobs.pop_front();
+            busy = true;
+            lock.unlock();
+            
+            auto t0 = std::chrono::steady_clock::now();
+            const char* path = job.path.c_str();
+            bool ok = SceneSerializer::write_file(path, SceneSerializer::is_binary_path(path)
+                                                            ? SceneSerializer::encode_binary(job.snapshot)
+                                                            : SceneSerializer::encode_text(job.snapshot));
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            
+            lock.lock();
+            results.push_back({std::move(job.path), ok, job.announce, ms});
+            busy = false;
+            idle.notify_all();
+        }
+    }
+    
+    static void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [] { return jobs.empty() && !busy; });
+    }
+    
+    static void poll() {
+        std::vector<Result> done;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done.swap(results);
+        }
+        for (const Result& result : done) {
+            if (!result.ok) {
+                log_console("Failed to save scene: " + result.path);
+            } else if (result.announce) {
+                char msg[64];
+                snprintf(msg, sizeof(msg), " (%.1f ms)", result.ms);
+                log_console("Scene saved: " + result.path + msg);
+            }
+        }
+    }
+    
+    // Finishes queued saves and stops the worker
+    static void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            wake.notify_one();
+        }
+        if (worker.joinable()) worker.join();
+        poll();
+    }
+};
+
+std::thread SceneSaver::worker;
+std::mutex SceneSaver::mutex;
+std::condition_variable SceneSaver::wake;
+std::condition_variable SceneSaver::idle;
+std::deque<SceneSaver::Job> SceneSaver::jobs;
+std::vector<SceneSaver::Result> SceneSaver::results;
+bool SceneSaver::busy = false;
+bool SceneSaver::stopping = false;
+
+// Editor History: undo/redo for editor edits, stored as per-component deltas. An entry
+// holds the before and after value of one component on one entity, or of every
+// component for entity creation and deletion, so memory follows what was edited
+// rather than scene size. Repeated changes from the same widget (a drag, typing into a
+// field) merge into one entry until the widget is released.
+struct EditorHistory {
+    enum Component : uint8_t { TRANSFORM, SPRITE, RIGIDBODY, SCRIPT, CAMERA, NAME, TAG, COMPONENT_COUNT };
+    
+    // Component value; monostate means the entity doesn't have it. Scripts, names and
+    // tags are stored as their string. A Rigidbody's body id only records whether the
+    // entity had a physics body.
+    using Value = std::variant<std::monostate, Transform, Sprite, Rigidbody, Camera, std::string>;
+    
+    struct Change {
+        Component component;
+        Value before;
+        Value after;
+    };
+    
+    enum class Lifetime : uint8_t { EDIT, CREATE, DESTROY };
+    
+    struct Entry {
+        EntityId entity;
+        uint32_t field; // Widget id the change came from; 0 never merges
+        Lifetime lifetime;
+        std::vector<Change> changes;
+    };
+    
+    static std::vector<Entry> undo_stack;
+    static std::vector<Entry> redo_stack;
+    static bool open; // The top entry can still absorb changes from its widget
+    static size_t max_entries;
+    
+    static Value capture(Registry& reg, EntityId e, Component component) {
+        switch (component) {
+        case TRANSFORM: if (Transform* t = reg.transforms.get(e)) return *t; break;
+        case SPRITE: if (Sprite* s = reg.sprites.get(e)) return *s; break;
+        case RIGIDBODY: if (Rigidbody* rb = reg.rigidbodies.get(e)) return *rb; break;
+        case CAMERA: if (Camera* c = reg.cameras.get(e)) return *c; break;
+        case SCRIPT: if (Script* s = reg.scripts.get(e)) return s->path; break;
+        case NAME: if (Name* n = reg.names.get(e)) return n->value; break;
+        case TAG: if (Tag* t = reg.tags.get(e)) return t->value; break;
+        default: break;
+        }
+        return std::monostate{};
+    }
+    
+    static void apply(Registry& reg, b2WorldId world, EntityId e, Component component, const Value& value) {
+        bool present = !std::holds_alternative<std::monostate>(value);
+        switch (component) {
+        case TRANSFORM:
+            if (!present) reg.transforms.remove(e);
+            else if (Transform* t = reg.transforms.get(e)) *t = std::get<Transform>(value);
+            else reg.transforms.add(e, std::get<Transform>(value));
+            break;
+        case SPRITE:
+            if (!present) reg.sprites.remove(e);
+            else if (Sprite* s = reg.sprites.get(e)) *s = std::get<Sprite>(value);
+            else reg.sprites.add(e, std::get<Sprite>(value));
+            break;
+        case RIGIDBODY: {
+            Rigidbody* rb = reg.rigidbodies.get(e);
+            if (!present) {
+                if (rb && b2Body_IsValid(rb->body)) b2DestroyBody(rb->body);
+                reg.rigidbodies.remove(e);
+            } else if (rb) {
+                b2BodyId body = rb->body;
+                *rb = std::get<Rigidbody>(value);
+                rb->body = body;
+                if (b2Body_IsValid(body)) {
+                    b2Body_SetType(body, rb->body_type);
+                    b2Body_SetFixedRotation(body, rb->fixed_rotation);
+                }
+            } else {
+                Rigidbody added = std::get<Rigidbody>(value);
+                bool had_body = B2_IS_NON_NULL(added.body);
+                added.body = b2_nullBodyId;
+                if (had_body && b2World_IsValid(world)) {
+                    PhysicsSystem::create_body(reg, world, e, added);
+                }
+                reg.rigidbodies.add(e, added);
+            }
+            break;
+        }
+        case CAMERA:
+            if (!present) reg.cameras.remove(e);
+            else if (Camera* c = reg.cameras.get(e)) *c = std::get<Camera>(value);
+            else reg.cameras.add(e, std::get<Camera>(value));
+            break;
+        case SCRIPT:
+            if (!present) {
+                reg.scripts.remove(e);
+            } else {
+                Script* s = reg.scripts.get(e);
+                if (!s) s = &reg.scripts.add(e, Script());
+                s->path = std::get<std::string>(value);
+                s->loaded = false; // Force reload
+                s->disabled = false;
+            }
+            break;
+        case NAME:
+            reg.set_name(e, present ? std::get<std::string>(value) : std::string());
+            break;
+        case TAG:
+            reg.set_tag(e, present ? std::get<std::string>(value) : std::string());
+            break;
+        default:
+            break;
+        }
+    }
+    
+    static void push(Entry&& entry) {
+        redo_stack.clear();
+        undo_stack.push_back(std::move(entry));
+        if (undo_stack.size() > max_entries) {
+            undo_stack.erase(undo_stack.begin());
+        }
+    }
+    
+    // A component changed from before to its current value
+    static void record(Registry& reg, EntityId e, Component component, uint32_t field, Value before) {
+        Value after = capture(reg, e, component);
+        if (open && field != 0 && !undo_stack.empty()) {
+            Entry& top = undo_stack.back();
+            if (top.lifetime == Lifetime::EDIT && top.entity == e && top.field == field &&
+                top.changes.size() == 1 && top.changes[0].component == component) {
+                top.changes[0].after = std::move(after);
+                redo_stack.clear();
+                return;
+            }
+        }
+        Entry entry{e, field, Lifetime::EDIT, {}};
+        entry.changes.push_back({component, std::move(before), std::move(after)});
+        push(std::move(entry));
+        open = field != 0;
+    }
+    
+    // Ends merging into the top entry; call when the editing widget is released
+    static void seal() {
+        open = false;
+    }
+    
+    static void record_create(Registry& reg, EntityId e) {
+        Entry entry{e, 0, Lifetime::CREATE, {}};
+        for (int c = 0; c < COMPONENT_COUNT; ++c) {
+            Value after = capture(reg, e, (Component)c);
+            if (!std::holds_alternative<std::monostate>(after)) {
+                entry.changes.push_back({(Component)c, std::monostate{}, std::move(after)});
+            }
+        }
+        push(std::move(entry));
+        open = false;
+    }
+    
+    // Records and performs the deletion, including the entity's physics body
+    static void destroy(Registry& reg, EntityId e) {
+        Entry entry{e, 0, Lifetime::DESTROY, {}};
+        for (int c = 0; c < COMPONENT_COUNT; ++c) {
+            Value before = capture(reg, e, (Component)c);
+            if (!std::holds_alternative<std::monostate>(before)) {
+                entry.changes.push_back({(Component)c, std::move(before), std::monostate{}});
+            }
+        }
+        push(std::move(entry));
+        open = false;
+        PhysicsSystem::destroy_entity(reg, e);
+    }
+    
+    // Applies one side of an entry; returns the entity to select afterwards
+    static EntityId apply_entry(Registry& reg, b2WorldId world, const Entry& entry, bool forward) {
+        Lifetime lifetime = entry.lifetime;
+        if (!forward && lifetime != Lifetime::EDIT) {
+            lifetime = lifetime == Lifetime::CREATE ? Lifetime::DESTROY : Lifetime::CREATE;
+        }
+        if (lifetime == Lifetime::DESTROY) {
+            PhysicsSystem::destroy_entity(reg, entry.entity);
+            return NULL_ENTITY;
+        }
+        if (lifetime == Lifetime::CREATE && !reg.revive(entry.entity)) {
+            return NULL_ENTITY;
+        }
+        if (!reg.valid(entry.entity)) return NULL_ENTITY;
+        for (const Change& change : entry.changes) {
+            apply(reg, world, entry.entity, change.component, forward ? change.after : change.before);
+        }
+        return entry.entity;
+    }
+    
+    static bool undo(Registry& reg, b2WorldId world, EntityId& selected) {
+        if (undo_stack.empty()) return false;
+        Entry entry = std::move(undo_stack.back());
+        undo_stack.pop_back();
+        selected = apply_entry(reg, world, entry, false);
+        redo_stack.push_back(std::move(entry));
+        open = false;
+        return true;
+    }
+    
+    static bool redo(Registry& reg, b2WorldId world, EntityId& selected) {
+        if (redo_stack.empty()) return false;
+        Entry entry = std::move(redo_stack.back());
+        redo_stack.pop_back();
+        selected = apply_entry(reg, world, entry, true);
+        undo_stack.push_back(std::move(entry));
+        open = false;
+        return true;
+    }
+    
+    static void clear() {
+        undo_stack.clear();
+        redo_stack.clear();
+        open = false;
+    }
+};
+
+std::vector<EditorHistory::Entry> EditorHistory::undo_stack;
+std::vector<EditorHistory::Entry> EditorHistory::redo_stack;
+bool EditorHistory::open = false;
+size_t EditorHistory::max_entries = 1000;
+
+// World Partition: a level split into square cells, stored as a directory holding a
+// world.txt manifest, one binary scene per non-empty cell (cell_<x>_<y>.3kscene) and
+// persistent.3kscene for named entities, which scripts look up and so stay resident.
+// Cells around the camera are read on a background thread, instantiated a time slice
+// at a time and destroyed again - bodies and scripts included - once the camera moves
+// away, so resident entities and step cost follow the camera instead of level size.
+// A streamed-out cell comes back as it is on disk.
+struct WorldPartition {
+    enum class CellState : uint8_t { READING, READ, LOADING, RESIDENT };
+    
+    struct Cell {
+        CellState state = CellState::READING;
+        std::string data; // File contents until instantiated
+        SceneSerializer::LoadCursor cursor;
+        std::vector<EntityId> entities;
+    };
+    
+    static std::string root; // World directory; empty when no world is open
+    static float cell_size;
+    static float load_radius; // Cells overlapping this square around the camera are loaded
+    static std::unordered_set<uint64_t> on_disk; // Cells listed in world.txt
+    static std::unordered_map<uint64_t, Cell> cells; // Cells being read, instantiated or resident
+    static bool prime; // The next update loads nearby cells before returning
+    
+    // Reader thread: file reads are the only work done off the main thread
+    static std::thread reader;
+    static std::mutex mutex;
+    static std::condition_variable wake;
+    static std::deque<uint64_t> read_queue;
+    static std::vector<std::pair<uint64_t, std::string>> read_done;
+    static bool stopping;
+    
+    static uint64_t key(int32_t x, int32_t y) {
+        return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+    }
+    
+    static std::string cell_path(const std::string& dir, uint64_t k) {
+        return dir + "/cell_" + std::to_string((int32_t)(k >> 32)) + "_" + std::to_string((int32_t)(uint32_t)k) + ".3kscene";
+    }
+    
+    static bool open(const std::string& dir, Registry& reg, b2WorldId world) {
+        close(reg);
+        std::string manifest;
+        if (!SceneSerializer::read_file((dir + "/world.txt").c_str(), manifest)) return false;
+        
+        cell_size = 1024.0f;
+        load_radius = 0.0f;
+        std::istringstream iss(manifest);
+        std::string line;
+        while (std::getline(iss, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            
+            std::istringstream lss(line);
+            std::string cmd;
+            lss >> cmd;
+            if (cmd == "cell_size") {
+                lss >> cell_size;
+            } else if (cmd == "load_radius") {
+                lss >> load_radius;
+            } else if (cmd == "cell") {
+                int32_t x, y;
+                if (lss >> x >> y) on_disk.insert(key(x, y));
+            }
+        }
+        if (cell_size <= 0.0f) cell_size = 1024.0f;
+        if (load_radius <= 0.0f) load_radius = cell_size * 1.5f;
+        
+        root = dir;
+        prime = true;
+        SceneSerializer::load((dir + "/persistent.3kscene").c_str(), reg, world);
+        
+        stopping = false;
+        reader = std::thread(read_loop);
+        return true;
+    }
+    
+    static void read_loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [] { return stopping || !read_queue.empty(); });
+            if (stopping) return;
+            
+            uint64_t k = read_queue.front();
+            read_queue.pop_front();
+            std::string path = cell_path(root, k);
+            lock.unlock();
+            
+            std::string data;
+            SceneSerializer::read_file(path.c_str(), data);
+            
+            lock.lock();
+            read_done.emplace_back(k, std::move(data));
+        }
+    }
+    
+    // Streams cells in and out around the camera; instantiation stops after budget_ms
+    static void update(Registry& reg, b2WorldId world, HMM_Vec2 camera, float budget_ms) {
+        if (root.empty()) return;
+        
+        int32_t x0 = (int32_t)floorf((camera.X - load_radius) / cell_size);
+        int32_t x1 = (int32_t)floorf((camera.X + load_radius) / cell_size);
+        int32_t y0 = (int32_t)floorf((camera.Y - load_radius) / cell_size);
+        int32_t y1 = (int32_t)floorf((camera.Y + load_radius) / cell_size);
+        
+        // Unload one cell further out than we load, so hovering on a border doesn't thrash
+        for (auto it = cells.begin(); it != cells.end();) {
+            int32_t x = (int32_t)(it->first >> 32), y = (int32_t)(uint32_t)it->first;
+            if (x < x0 - 1 || x > x1 + 1 || y < y0 - 1 || y > y1 + 1) {
+                unload(reg, it->first, it->second);
+                it = cells.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        
+        for (int32_t y = y0; y <= y1; ++y) {
+            for (int32_t x = x0; x <= x1; ++x) {
+                uint64_t k = key(x, y);
+                if (!on_disk.count(k) || cells.count(k)) continue;
+                Cell& cell = cells[k];
+                if (prime) {
+                    SceneSerializer::read_file(cell_path(root, k).c_str(), cell.data);
+                    cell.state = CellState::READ;
+                } else {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    read_queue.push_back(k);
+                    wake.notify_one();
+                }
+            }
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& [k, data] : read_done) {
+                auto it = cells.find(k);
+                if (it != cells.end() && it->second.state == CellState::READING) {
+                    it->second.data = std::move(data);
+                    it->second.state = CellState::READ;
+                }
+            }
+            read_done.clear();
+        }
+        
+        auto deadline = prime ? std::chrono::steady_clock::time_point::max()
+                              : std::chrono::steady_clock::now() + std::chrono::microseconds((int64_t)(budget_ms * 1000.0f));
+        prime = false;
+        for (auto& [k, cell] : cells) {
+            if (cell.state == CellState::READ) {
+                cell.cursor.data = cell.data;
+                if (!SceneSerializer::begin_load(cell.cursor, reg) || !cell.cursor.binary) {
+                    log_console("World cell is not a valid .3kscene: " + cell_path(root, k));
+                    cell.cursor = SceneSerializer::LoadCursor();
+                    cell.data = std::string();
+                    cell.state = CellState::RESIDENT;
+                    continue;
+                }
+                cell.state = CellState::LOADING;
+            }
+            if (cell.state == CellState::LOADING) {
+                SceneSerializer::load_step(cell.cursor, reg, world, deadline);
+                if (cell.cursor.done || cell.cursor.failed) {
+                    cell.entities = std::move(cell.cursor.ids);
+                    cell.cursor = SceneSerializer::LoadCursor();
+                    cell.data = std::string();
+                    cell.state = CellState::RESIDENT;
+                }
+                if (std::chrono::steady_clock::now() >= deadline) break;
+            }
+        }
+    }
+    
+    static void unload(Registry& reg, uint64_t k, Cell& cell) {
+        // A loading cell created all of its entities up front
+        const std::vector<EntityId>& entities = cell.state == CellState::LOADING ? cell.cursor.ids : cell.entities;
+        for (EntityId e : entities) {
+            PhysicsSystem::destroy_entity(reg, e);
+        }
+        if (cell.state == CellState::READING) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = std::find(read_queue.begin(), read_queue.end(), k);
+            if (it != read_queue.end()) read_queue.erase(it);
+        }
+    }
+    
+    // Drops every cell; the next update loads the ones around the camera again
+    static void unload_all(Registry& reg) {
+        for (auto& [k, cell] : cells) {
+            unload(reg, k, cell);
+        }
+        cells.clear();
+        std::lock_guard<std::mutex> lock(mutex);
+        read_queue.clear();
+        read_done.clear();
+        prime = true;
+    }
+    
+    static void close(Registry& reg) {
+        unload_all(reg);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            wake.notify_one();
+        }
+        if (reader.joinable()) reader.join();
+        read_done.clear();
+        root.clear();
+        on_disk.clear();
+    }
+    
+    static void resident(size_t& cell_count, size_t& entity_count) {
+        cell_count = 0;
+        entity_count = 0;
+        for (auto& [k, cell] : cells) {
+            if (cell.state != CellState::RESIDENT) continue;
+            cell_count++;
+            entity_count += cell.entities.size();
+        }
+    }
+    
+    // Copies the saved components of src_entity into dst as a new entity
+    static void copy_entity(Registry& src, EntityId e, Registry& dst) {
+        EntityId c = dst.create();
+        dst.transforms.add(c, *src.transforms.get(e));
+        if (Sprite* sprite = src.sprites.get(e)) dst.sprites.add(c, *sprite);
+        if (Rigidbody* rb = src.rigidbodies.get(e)) {
+            Rigidbody copy = *rb;
+            copy.body = b2_nullBodyId;
+            dst.rigidbodies.add(c, copy);
+        }
+        if (Script* script = src.scripts.get(e)) {
+            Script copy;
+            copy.path = script->path;
+            dst.scripts.add(c, copy);
+        }
+        if (Name* name = src.names.get(e)) dst.set_name(c, name->value);
+        if (Tag* tag = src.tags.get(e)) dst.set_tag(c, tag->value);
+    }
+    
+    // Splits a scene into a world directory
+    static bool partition(Registry& scene, const std::string& dir, float size, size_t& cell_count) {
+        std::map<uint64_t, Registry> split;
+        Registry persistent;
+        scene.transforms.each([&](EntityId e, Transform& t) {
+            if (scene.names.has(e)) {
+                copy_entity(scene, e, persistent);
+            } else {
+                copy_entity(scene, e, split[key((int32_t)floorf(t.position.X / size), (int32_t)floorf(t.position.Y / size))]);
+            }
+        });
+        
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        if (ec) return false;
+        
+        std::string manifest = "# World\ncell_size " + std::to_string(size) + "\n";
+        bool ok = SceneSerializer::save((dir + "/persistent.3kscene").c_str(), persistent);
+        for (auto& [k, cell] : split) {
+            ok = ok && SceneSerializer::save(cell_path(dir, k).c_str(), cell);
+            manifest += "cell " + std::to_string((int32_t)(k >> 32)) + " " + std::to_string((int32_t)(uint32_t)k) + "\n";
+        }
+        cell_count = split.size();
+        return ok && SceneSerializer::write_file((dir + "/world.txt").c_str(), manifest);
+    }
+};
+
+std::string WorldPartition::root;
+float WorldPartition::cell_size = 1024.0f;
+float WorldPartition::load_radius = 1536.0f;
+std::unordered_set<uint64_t> WorldPartition::on_disk;
+std::unordered_map<uint64_t, WorldPartition::Cell> WorldPartition::cells;
+bool WorldPartition::prime = false;
+std::thread WorldPartition::reader;
+std::mutex WorldPartition::mutex;
+std::condition_variable WorldPartition::wake;
+std::deque<uint64_t> WorldPartition::read_queue;
+std::vector<std::pair<uint64_t, std::string>> WorldPartition::read_done;
+bool WorldPartition::stopping = false;
+
+// Project Settings: per-project options read from project.txt ("key value" lines)
+struct ProjectSettings {
+    bool lua_gc_generational = false; // "lua_gc generational" or "lua_gc incremental"
+    float lua_gc_budget_ms = 1.0f;    // GC time per frame; 0 leaves Lua's automatic collector on
+    float script_budget_ms = 100.0f;  // Longest single script call before it is aborted; 0 disables
+    int64_t script_instruction_budget = 0; // Lua instructions per call; 0 disables
+    int script_shards = 0;            // Worker VMs for --!parallel scripts; 0 runs them on the main state
+    float scene_stream_budget_ms = 4.0f; // Editor scene loading time per frame
+    float texture_upload_budget_ms = 2.0f; // Decoded texture uploads per frame
+    float texture_budget_mb = 256.0f; // Texture memory before unreferenced textures are evicted
+    
+    bool load(const char* path) {
+        PHYSFS_File* file = PHYSFS_openRead(path);
+        if (!file) return false;
+        
+        std::string content((size_t)std::max<PHYSFS_sint64>(PHYSFS_fileLength(file), 0), '\0');
+        PHYSFS_readBytes(file, content.data(), content.size());
+        PHYSFS_close(file);
+        
+        std::istringstream iss(content);
+        std::string line;
+        while (std::getline(iss, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            
+            std::istringstream lss(line);
+            std::string key;
+            lss >> key;
+            if (key == "lua_gc") {
+                std::string mode;
+                lss >> mode;
+                lua_gc_generational = (mode == "generational");
+            } else if (key == "lua_gc_budget_ms") {
+                lss >> lua_gc_budget_ms;
+            } else if (key == "script_budget_ms") {
+                lss >> script_budget_ms;
+            } else if (key == "script_instruction_budget") {
+                lss >> script_instruction_budget;
+            } else if (key == "script_shards") {
+                lss >> script_shards;
+            } else if (key == "scene_stream_budget_ms") {
+                lss >> scene_stream_budget_ms;
+            } else if (key == "texture_upload_budget_ms") {
+                lss >> texture_upload_budget_ms;
+            } else if (key == "texture_budget_mb") {
+                lss >> texture_budget_mb;
+            }
+        }
+        return true;
+    }
+};
+
+// Input state consumed by one fixed step, packed for recording
+struct InputFrame {
+    uint8_t keys[SAPP_MAX_KEYCODES / 8];
+    uint8_t keys_pressed[SAPP_MAX_KEYCODES / 8];
+    float mouse_x;
+    float mouse_y;
+    uint8_t mouse_buttons;
+    uint8_t pad[3];
+    
+    bool operator==(const InputFrame& other) const { return memcmp(this, &other, sizeof(InputFrame)) == 0; }
+    bool operator!=(const InputFrame& other) const { return !(*this == other); }
+};
+
+// Input System
+struct InputSystem {
+    static bool keys[SAPP_MAX_KEYCODES];
+    static bool keys_pressed[SAPP_MAX_KEYCODES];
+    static HMM_Vec2 mouse_pos;
+    static bool mouse_buttons[3];
+    
+    static void reset() {
+        for (int i = 0; i < SAPP_MAX_KEYCODES; ++i) {
+            keys_pressed[i] = false;
+        }
+    }
+    
+    static bool get_key(sapp_keycode key) { return keys[key]; }
+    static bool get_key_down(sapp_keycode key) { return keys_pressed[key]; }
+    static HMM_Vec2 get_mouse_position() { return mouse_pos; }
+    static bool get_mouse_button(int button) { return button < 3 ? mouse_buttons[button] : false; }
+    
+    static InputFrame capture() {
+        InputFrame f = {};
+        for (int i = 0; i < SAPP_MAX_KEYCODES; ++i) {
+            if (keys[i]) f.keys[i >> 3] |= (uint8_t)(1 << (i & 7));
+            if (keys_pressed[i]) f.keys_pressed[i >> 3] |= (uint8_t)(1 << (i & 7));
+        }
+        f.mouse_x = mouse_pos.X;
+        f.mouse_y = mouse_pos.Y;
+        for (int i = 0; i < 3; ++i) {
+            if (mouse_buttons[i]) f.mouse_buttons |= (uint8_t)(1 << i);
+        }
+        return f;
+    }
+    
+    static void apply(const InputFrame& f) {
+        for (int i = 0; i < SAPP_MAX_KEYCODES; ++i) {
+            keys[i] = (f.keys[i >> 3] >> (i & 7)) & 1;
+            keys_pressed[i] = (f.keys_pressed[i >> 3] >> (i & 7)) & 1;
+        }
+        mouse_pos = {f.mouse_x, f.mouse_y};
+        for (int i = 0; i < 3; ++i) {
+            mouse_buttons[i] = (f.mouse_buttons >> i) & 1;
+        }
+    }
+};
+
+bool InputSystem::keys[SAPP_MAX_KEYCODES] = {};
+bool InputSystem::keys_pressed[SAPP_MAX_KEYCODES] = {};
+HMM_Vec2 InputSystem::mouse_pos = {0, 0};
+bool InputSystem::mouse_buttons[3] = {};
+
+// Input Recording: a scene snapshot plus the input consumed at each fixed step.
+// Only steps where the input changed are stored.
+struct InputRecording {
+    static constexpr uint32_t MAGIC = 0x52494B33; // "3KIR"
+    static constexpr uint32_t VERSION = 2; // Version 1 files load without script_shards
+    
+    uint32_t seed = 0;
+    float step = 1.0f / 60.0f;
+    uint32_t step_count = 0;
+    uint64_t final_checksum = 0;
+    int32_t script_shards = -1; // Shard count the session ran with, -1 if not recorded
+    std::string scene;
+    std::vector<std::pair<uint32_t, InputFrame>> changes;
+    
+    bool save(const char* path) const {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open()) return false;
+        
+        uint32_t scene_len = (uint32_t)scene.size();
+        uint32_t change_count = (uint32_t)changes.size();
+        file.write((const char*)&MAGIC, sizeof(MAGIC));
+        file.write((const char*)&VERSION, sizeof(VERSION));
+        file.write((const char*)&seed, sizeof(seed));
+        file.write((const char*)&step, sizeof(step));
+        file.write((const char*)&step_count, sizeof(step_count));
+        file.write((const char*)&final_checksum, sizeof(final_checksum));
+        file.write((const char*)&script_shards, sizeof(script_shards));
+        file.write((const char*)&scene_len, sizeof(scene_len));
+        file.write(scene.data(), scene_len);
+        file.write((const char*)&change_count, sizeof(change_count));
+        for (const auto& c : changes) {
+            file.write((const char*)&c.first, sizeof(c.first));
+            file.write((const char*)&c.second, sizeof(InputFrame));
+        }
+        return file.good();
+    }
+    
+    bool load(const char* path) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) return false;
+        std::streamoff file_size = file.tellg();
+        file.seekg(0);
+        // Lengths come from the file, so check them against what is left of it before allocating
+        auto remaining = [&] { return (uint64_t)std::max<std::streamoff>(file_size - file.tellg(), 0); };
+        
+        uint32_t magic = 0, version = 0, scene_len = 0, change_count = 0;
+        file.read((char*)&magic, sizeof(magic));
+        file.read((char*)&version, sizeof(version));
+        if (magic != MAGIC || version < 1 || version > VERSION) return false;
+        file.read((char*)&seed, sizeof(seed));
+        file.read((char*)&step, sizeof(step));
+        file.read((char*)&step_count, sizeof(step_count));
+        file.read((char*)&final_checksum, sizeof(final_checksum));
+        script_shards = -1;
+        if (version >= 2) file.read((char*)&script_shards, sizeof(script_shards));
+        file.read((char*)&scene_len, sizeof(scene_len));
+        if (!file.good() || scene_len > remaining()) return false;
+        scene.resize(scene_len);
+        file.read(scene.data(), scene_len);
+        file.read((char*)&change_count, sizeof(change_count));
+        constexpr uint64_t CHANGE_SIZE = sizeof(uint32_t) + sizeof(InputFrame);
+        if (!file.good() || (uint64_t)change_count * CHANGE_SIZE > remaining()) return false;
+        changes.resize(change_count);
+        for (auto& c : changes) {
+            file.read((char*)&c.first, sizeof(c.first));
+            file.read((char*)&c.second, sizeof(InputFrame));
+        }
+        return file.good();
+    }
+};
+
+struct InputRecorder {
+    static bool recording;
+    static InputRecording rec;
+    static InputFrame last;
+    
+    static void begin(const std::string& scene, uint32_t seed, float step, int script_shards) {
+        rec = InputRecording();
+        rec.scene = scene;
+        rec.seed = seed;
+        rec.step = step;
+        rec.script_shards = script_shards;
+        recording = true;
+    }
+    
+    // Called once per fixed step, before the step consumes input
+    static void record_step() {
+        if (!recording) return;
+        InputFrame f = InputSystem::capture();
+        if (rec.step_count == 0 || f != last) {
+            rec.changes.push_back({rec.step_count, f});
+            last = f;
+        }
+        rec.step_count++;
+    }
+    
+    static bool end(const char* path, uint64_t checksum) {
+        if (!recording) return false;
+        recording = false;
+        rec.final_checksum = checksum;
+        return rec.save(path);
+    }
+};
+
+bool InputRecorder::recording = false;
+InputRecording InputRecorder::rec;
+InputFrame InputRecorder::last = {};
+
+// Replays recorded input step by step
+struct InputReplayer {
+    const InputRecording* rec = nullptr;
+    size_t cursor = 0;
+    
+    void apply_step(uint32_t step_index) {
+        while (cursor < rec->changes.size() && rec->changes[cursor].first <= step_index) {
+            InputSystem::apply(rec->changes[cursor].second);
+            cursor++;
+        }
+    }
+};
+
+static uint32_t next_script_serial = 0; // Source of Script::instance_serial
+
+static void report_script_error(Script& script, const std::string& msg) {
+    if (script.error_reported) return;
+    script.error_reported = true;
+    log_console("Error in script " + script.path + ": " + msg);
+}
+
+// Script Profiler: wall time of each update call and coroutine resume, grouped
+// by script path. Sampling mode additionally installs an instruction count hook
+// that attributes the time between samples to the current Lua call stack.
+struct ScriptProfiler {
+    using Clock = std::chrono::steady_clock;
+    
+    struct PathStats {
+        std::string path;
+        uint64_t calls = 0;
+        double total_ms = 0.0;
+        double max_ms = 0.0;
+    };
+    
+    static bool enabled;
+    static bool sampling;
+    static std::vector<PathStats> paths;
+    static std::unordered_map<std::string, uint32_t> path_index;
+    static std::unordered_map<std::string, double> stacks; // Folded stack -> microseconds
+    static Clock::time_point last_sample;
+    
+    static uint32_t slot(const std::string& path) {
+        auto it = path_index.find(path);
+        if (it != path_index.end()) return it->second;
+        uint32_t index = (uint32_t)paths.size();
+        paths.push_back(PathStats());
+        paths.back().path = path;
+        path_index[path] = index;
+        return index;
+    }
+    
+    static Clock::time_point begin() {
+        last_sample = Clock::now();
+        return last_sample;
+    }
+    
+    static void end(uint32_t slot, Clock::time_point t0) {
+        Clock::time_point now = Clock::now();
+        if (sampling) {
+            sample_remainder(now);
+        }
+        double ms = std::chrono::duration<double, std::milli>(now - t0).count();
+        PathStats& stats = paths[slot];
+        stats.calls++;
+        stats.total_ms += ms;
+        stats.max_ms = std::max(stats.max_ms, ms);
+    }
+    
+    // Called from the shared count hook, see install_script_hook
+    static void sample(lua_State* L) {
+        Clock::time_point now = Clock::now();
+        double us = std::chrono::duration<double, std::micro>(now - last_sample).count();
+        last_sample = now;
+        
+        // Walk from the leaf up, then emit root-first as flamegraph folded stacks
+        std::vector<std::string> frames;
+        lua_Debug info;
+        for (int level = 0; lua_getstack(L, level, &info); ++level) {
+            lua_getinfo(L, "Sln", &info);
+            std::string frame = info.name ? info.name : (strcmp(info.what, "main") == 0 ? "main" : "function");
+            frame += " (";
+            frame += info.short_src;
+            if (info.linedefined > 0) frame += ":" + std::to_string(info.linedefined);
+            frame += ")";
+            if (level == 0 && info.currentline > 0) {
+                frames.push_back(std::string(info.short_src) + ":" + std::to_string(info.currentline));
+            }
+            frames.push_back(frame);
+        }
+        std::string folded;
+        for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+            if (!folded.empty()) folded += ";";
+            folded += *it;
+        }
+        stacks[folded] += us;
+        last_stack = folded;
+    }
+    
+    // Time after the last sample of a call goes to the last sampled stack
+    static void sample_remainder(Clock::time_point now) {
+        if (last_stack.empty()) return;
+        stacks[last_stack] += std::chrono::duration<double, std::micro>(now - last_sample).count();
+        last_stack.clear();
+    }
+    
+    static void reset() {
+        for (auto& stats : paths) {
+            stats.calls = 0;
+            stats.total_ms = stats.max_ms = 0.0;
+        }
+        stacks.clear();
+        last_stack.clear();
+    }
+    
+    // Writes samples in the folded format read by flamegraph.pl and speedscope
+    static bool dump_folded(const char* path) {
+        std::ofstream file(path);
+        if (!file.is_open()) return false;
+        for (const auto& pair : stacks) {
+            uint64_t us = (uint64_t)(pair.second + 0.5);
+            if (us > 0) file << pair.first << " " << us << "\n";
+        }
+        return true;
+    }
+    
+    static std::string last_stack;
+};
+
+bool ScriptProfiler::enabled = false;
+bool ScriptProfiler::sampling = false;
+std::vector<ScriptProfiler::PathStats> ScriptProfiler::paths;
+std::unordered_map<std::string, uint32_t> ScriptProfiler::path_index;
+std::unordered_map<std::string, double> ScriptProfiler::stacks;
+ScriptProfiler::Clock::time_point ScriptProfiler::last_sample;
+std::string ScriptProfiler::last_stack;
+
+// Script Watchdog: every script call runs armed, and the count hook aborts it
+// with a Lua error once it exceeds the instruction or time budget. The caller
+// sees an ordinary script error and disables the script, so an infinite loop
+// costs one budget instead of freezing the frame loop.
+struct ScriptWatchdog {
+    static float budget_ms;
+    static int64_t instruction_budget;
+    // Per thread, so shard workers each watch their own calls
+    static thread_local bool armed;
+    static thread_local bool tripped;
+    static thread_local int64_t instructions;
+    static thread_local std::chrono::steady_clock::time_point start;
+    static thread_local lua_State* tripped_thread;
+    static thread_local int tripped_interval;
+    
+    static bool active() {
+        return budget_ms > 0.0f || instruction_budget > 0;
+    }
+    
+    static void arm() {
+        armed = true;
+        tripped = false;
+        instructions = 0;
+        start = std::chrono::steady_clock::now();
+    }
+    
+    // Returns true when the call was aborted by the watchdog
+    static bool disarm() {
+        armed = false;
+        if (tripped && tripped_thread) {
+            lua_sethook(tripped_thread, lua_gethook(tripped_thread), LUA_MASKCOUNT, tripped_interval);
+            tripped_thread = nullptr;
+        }
+        return tripped;
+    }
+    
+    // Once tripped, the hook fires on every instruction and keeps raising, so a
+    // pcall inside the script can't swallow the abort
+    static void check(lua_State* L, int interval) {
+        if (!armed) return;
+        if (!tripped) {
+            instructions += interval;
+            tripped = instruction_budget > 0 && instructions > instruction_budget;
+            if (!tripped && budget_ms > 0.0f) {
+                tripped = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() > budget_ms;
+            }
+            if (!tripped) return;
+            tripped_thread = L;
+            tripped_interval = interval;
+            lua_sethook(L, lua_gethook(L), LUA_MASKCOUNT, 1);
+        }
+        luaL_error(L, "script exceeded its budget (%lld instructions, %.1f ms limit)", (long long)instructions, budget_ms);
+    }
+    
+    static void disable(Script& script) {
+        script.disabled = true;
+        script.update_fn = sol::protected_function();
+        script.coroutine = UINT32_MAX; // The scheduler releases the orphaned coroutine
+        log_console("Script " + script.path + " exceeded its execution budget and was disabled");
+    }
+};
+
+float ScriptWatchdog::budget_ms = 100.0f;
+int64_t ScriptWatchdog::instruction_budget = 0;
+thread_local bool ScriptWatchdog::armed = false;
+thread_local bool ScriptWatchdog::tripped = false;
+thread_local int64_t ScriptWatchdog::instructions = 0;
+thread_local std::chrono::steady_clock::time_point ScriptWatchdog::start;
+thread_local lua_State* ScriptWatchdog::tripped_thread = nullptr;
+thread_local int ScriptWatchdog::tripped_interval = 0;
+
+// Event names are interned once; the bus, waiters and subscribers work with ids.
+// Scripts can pass either the name or the id returned by event("name").
+struct EventNames {
+    static std::unordered_map<std::string, uint32_t> ids;
+    static std::vector<std::string> names;
+    static std::mutex mutex; // Shard scripts intern names from worker threads
+    
+    static uint32_t intern(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = ids.find(name);
+        if (it != ids.end()) return it->second;
+        uint32_t id = (uint32_t)names.size();
+        names.push_back(name);
+        ids[name] = id;
+        return id;
+    }
+    
+    static uint32_t from(const sol::object& event) {
+        if (event.get_type() == sol::type::number) return event.as<uint32_t>();
+        return intern(event.as<std::string>());
+    }
+};
+
+std::unordered_map<std::string, uint32_t> EventNames::ids;
+std::vector<std::string> EventNames::names;
+std::mutex EventNames::mutex;
+
+// Script Scheduler: a script's optional `run` function executes as a coroutine
+// that can wait(seconds), wait_frames(n) or wait_until(event). Sleeping
+// coroutines sit in a min-heap keyed by wake step and event waiters in
+// per-event lists, so an idle script costs nothing per tick.
+struct ScriptScheduler {
+    struct Coroutine {
+        sol::thread thread;
+        EntityId owner;
+        uint32_t generation; // Bumped when the slot is freed, invalidating stale wakeups
+        bool started;
+    };
+    
+    struct Sleeper {
+        uint64_t wake_step;
+        uint32_t slot;
+        uint32_t generation;
+        bool operator>(const Sleeper& other) const { return wake_step > other.wake_step; }
+    };
+    
+    enum WaitKind { WAIT_NEXT_STEP, WAIT_STEPS, WAIT_EVENT };
+    
+    static std::vector<Coroutine> coroutines;
+    static std::vector<uint32_t> free_slots;
+    static std::priority_queue<Sleeper, std::vector<Sleeper>, std::greater<Sleeper>> sleepers;
+    static std::unordered_map<uint32_t, std::vector<Sleeper>> event_waiters;
+    static std::vector<Sleeper> ready; // Resumed at the next run()
+    static uint64_t current_step;
+    static float step_dt;
+    
+    // Set by the wait functions right before they yield
+    static WaitKind pending_kind;
+    static uint64_t pending_steps;
+    static uint32_t pending_event;
+    
+    static void bind(sol::state* lua) {
+        lua->set_function("wait", sol::yielding([](float seconds) {
+            pending_kind = WAIT_STEPS;
+            pending_steps = (uint64_t)std::max(1.0f, std::ceil(seconds / step_dt));
+        }));
+        lua->set_function("wait_frames", sol::yielding([](int frames) {
+            pending_kind = WAIT_STEPS;
+            pending_steps = (uint64_t)std::max(1, frames);
+        }));
+        lua->set_function("wait_until", sol::yielding([](sol::object event) {
+            pending_kind = WAIT_EVENT;
+            pending_event = EventNames::from(event);
+        }));
+    }
+    
+    static void start(Script& script, EntityId e, sol::state* lua) {
+        uint32_t slot;
+        if (!free_slots.empty()) {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        } else {
+            slot = (uint32_t)coroutines.size();
+            coroutines.push_back(Coroutine());
+        }
+        Coroutine& co = coroutines[slot];
+        co.thread = sol::thread::create(lua->lua_state());
+        co.owner = e;
+        co.started = false;
+        script.run_fn.push(co.thread.thread_state());
+        script.coroutine = slot;
+        script.coroutine_generation = co.generation;
+        ready.push_back({current_step, slot, co.generation});
+    }
+    
+    // Called by EventBus::dispatch for every delivered event
+    static void signal(uint32_t event) {
+        auto it = event_waiters.find(event);
+        if (it == event_waiters.end()) return;
+        ready.insert(ready.end(), it->second.begin(), it->second.end());
+        it->second.clear();
+    }
+    
+    // Resumes every coroutine that is due this step
+    static void run(Registry& reg, float dt) {
+        step_dt = dt;
+        current_step++;
+        
+        std::vector<Sleeper> due;
+        due.swap(ready);
+        while (!sleepers.empty() && sleepers.top().wake_step <= current_step) {
+            due.push_back(sleepers.top());
+            sleepers.pop();
+        }
+        for (const Sleeper& s : due) {
+            resume(reg, s);
+        }
+    }
+    
+    static void resume(Registry& reg, const Sleeper& s) {
+        if (s.slot >= coroutines.size() || coroutines[s.slot].generation != s.generation) return;
+        Coroutine& co = coroutines[s.slot];
+        
+        // The owner may have been destroyed or its script reloaded while the coroutine slept
+        Script* script = reg.scripts.get(co.owner);
+        if (!script || script->coroutine != s.slot || script->coroutine_generation != s.generation) {
+            release(s.slot);
+            return;
+        }
+        
+        lua_State* L = co.thread.thread_state();
+        pending_kind = WAIT_NEXT_STEP;
+        int nres = 0;
+        auto t0 = ScriptProfiler::enabled ? ScriptProfiler::begin() : ScriptProfiler::Clock::time_point();
+        ScriptWatchdog::arm();
+        int status = lua_resume(L, nullptr, 0, &nres);
+        bool aborted = ScriptWatchdog::disarm();
+        if (ScriptProfiler::enabled) ScriptProfiler::end(script->profile_slot, t0);
+        co.started = true;
+        if (status == LUA_YIELD) {
+            lua_pop(L, nres);
+            Sleeper next = {current_step + 1, s.slot, s.generation};
+            if (pending_kind == WAIT_STEPS) {
+                next.wake_step = current_step + pending_steps;
+                sleepers.push(next);
+            } else if (pending_kind == WAIT_EVENT) {
+                event_waiters[pending_event].push_back(next);
+            } else {
+                sleepers.push(next); // plain coroutine.yield()
+            }
+            return;
+        }
+        if (aborted) {
+            ScriptWatchdog::disable(*script);
+        } else if (status != LUA_OK) {
+            const char* msg = lua_tostring(L, -1);
+            report_script_error(*script, msg ? msg : "coroutine error");
+        }
+        script->coroutine = UINT32_MAX;
+        release(s.slot);
+    }
+    
+    static void release(uint32_t slot) {
+        Coroutine& co = coroutines[slot];
+        co.thread = sol::thread();
+        co.generation++;
+        free_slots.push_back(slot);
+    }
+    
+    // Drops every coroutine; must run before the Lua state they belong to is closed
+    static void clear() {
+        coroutines.clear();
+        free_slots.clear();
+        sleepers = decltype(sleepers)();
+        event_waiters.clear();
+        ready.clear();
+        current_step = 0;
+    }
+};
+
+std::vector<ScriptScheduler::Coroutine> ScriptScheduler::coroutines;
+std::vector<uint32_t> ScriptScheduler::free_slots;
+std::priority_queue<ScriptScheduler::Sleeper, std::vector<ScriptScheduler::Sleeper>, std::greater<ScriptScheduler::Sleeper>> ScriptScheduler::sleepers;
+std::unordered_map<uint32_t, std::vector<ScriptScheduler::Sleeper>> ScriptScheduler::event_waiters;
+std::vector<ScriptScheduler::Sleeper> ScriptScheduler::ready;
+uint64_t ScriptScheduler::current_step = 0;
+float ScriptScheduler::step_dt = 1.0f / 60.0f;
+ScriptScheduler::WaitKind ScriptScheduler::pending_kind = ScriptScheduler::WAIT_NEXT_STEP;
+uint64_t ScriptScheduler::pending_steps = 0;
+uint32_t ScriptScheduler::pending_event = 0;
+
+// Event Bus: emit(event, ...) queues a message with up to four numbers as
+// payload; dispatch() delivers the queue once per step, after script updates.
+// Handlers registered with subscribe(event, fn) receive the payload as plain
+// arguments, so no table is created per message, and coroutines blocked in
+// wait_until(event) resume in the same step. Events emitted while dispatching
+// are delivered in the next step.
+struct EventBus {
+    static constexpr int MAX_ARGS = 4;
+    
+    struct Event {
+        uint32_t id;
+        uint32_t argc;
+        double args[MAX_ARGS];
+    };
+    
+    struct Subscriber {
+        EntityId owner;
+        uint32_t serial; // Script::instance_serial at subscribe time
+        sol::protected_function fn;
+    };
+    
+    static std::vector<Event> queue;
+    static std::unordered_map<uint32_t, std::vector<Subscriber>> subscribers;
+    
+    static void emit(uint32_t id, const double* args = nullptr, uint32_t argc = 0) {
+        Event ev;
+        ev.id = id;
+        ev.argc = std::min<uint32_t>(argc, MAX_ARGS);
+        for (uint32_t i = 0; i < ev.argc; ++i) ev.args[i] = args[i];
+        queue.push_back(ev);
+    }
+    
+    // Interested means a subscriber or a waiting coroutine; engine events are
+    // only produced when someone listens
+    static bool has_listeners(uint32_t id) {
+        auto sub = subscribers.find(id);
+        if (sub != subscribers.end() && !sub->second.empty()) return true;
+        auto wait = ScriptScheduler::event_waiters.find(id);
+        return wait != ScriptScheduler::event_waiters.end() && !wait->second.empty();
+    }
+    
+    static void subscribe(uint32_t id, EntityId owner, uint32_t serial, sol::protected_function fn) {
+        subscribers[id].push_back({owner, serial, std::move(fn)});
+    }
+    
+    static void unsubscribe(uint32_t id, EntityId owner) {
+        auto it = subscribers.find(id);
+        if (it == subscribers.end()) return;
+        auto& subs = it->second;
+        subs.erase(std::remove_if(subs.begin(), subs.end(), [&](const Subscriber& s) { return s.owner == owner; }), subs.end());
+    }
+    
+    // The bindings shared by the main state and the shards; the caller's entity
+    // comes from the environment of the calling function. Shards pass callbacks that
+    // queue emits and subscription changes instead of touching the bus directly.
+    using SubscribeFn = void (*)(uint32_t, EntityId, uint32_t, sol::protected_function);
+    using UnsubscribeFn = void (*)(uint32_t, EntityId);
+    static void bind(sol::state& lua, void (*on_emit)(uint32_t, const double*, uint32_t),
+                     SubscribeFn on_subscribe = subscribe, UnsubscribeFn on_unsubscribe = unsubscribe) {
+        lua.set_function("event", [](const std::string& name) {
+            return EventNames::intern(name);
+        });
+        lua.set_function("emit", [on_emit](sol::object event, sol::variadic_args va) {
+            double args[MAX_ARGS];
+            uint32_t argc = 0;
+            for (auto v : va) {
+                if (argc == MAX_ARGS) break;
+                // Thrown rather than luaL_argerror, which would longjmp past va's destructors
+                if (v.get_type() != sol::type::number) {
+                    throw sol::error("bad argument #" + std::to_string(argc + 2) + " to 'emit' (number expected, got " +
+                                     sol::type_name(va.lua_state(), v.get_type()) + ")");
+                }
+                args[argc++] = v.as<double>();
+            }
+            on_emit(EventNames::from(event), args, argc);
+        });
+        lua.set_function("signal", [on_emit](sol::object event) {
+            on_emit(EventNames::from(event), nullptr, 0);
+        });
+        lua.set_function("subscribe", [on_subscribe](sol::object event, sol::protected_function fn, sol::this_environment te) {
+            if (!te) return;
+            sol::environment& env = te;
+            EntityId owner = {env["entity_id"].get_or(UINT32_MAX), env["entity_generation"].get_or(0u)};
+            on_subscribe(EventNames::from(event), owner, env["_serial"].get_or(0u), std::move(fn));
+        });
+        lua.set_function("unsubscribe", [on_unsubscribe](sol::object event, sol::this_environment te) {
+            if (!te) return;
+            sol::environment& env = te;
+            on_unsubscribe(EventNames::from(event), {env["entity_id"].get_or(UINT32_MAX), env["entity_generation"].get_or(0u)});
+        });
+    }
+    
+    // Whole numbers arrive as Lua integers, so entity ids compare and index as usual
+    static bool call(const sol::protected_function& fn, const Event& ev, std::string& error) {
+        lua_State* L = fn.lua_state();
+        fn.push(L);
+        for (uint32_t i = 0; i < ev.argc; ++i) {
+            double v = ev.args[i];
+            if (v == std::floor(v) && std::fabs(v) < 9007199254740992.0) {
+                lua_pushinteger(L, (lua_Integer)v);
+            } else {
+                lua_pushnumber(L, v);
+            }
+        }
+        if (lua_pcall(L, (int)ev.argc, 0, 0) == LUA_OK) return true;
+        error = lua_tostring(L, -1) ? lua_tostring(L, -1) : "event handler error";
+        lua_pop(L, 1);
+        return false;
+    }
+    
+    // enter_script returns a guard holding the calling context for a handler
+    // (see ScriptShards::Scope)
+    template <typename EnterScript>
+    static void dispatch(Registry& reg, EnterScript enter_script) {
+        if (queue.empty()) return;
+        std::vector<Event> events;
+        events.swap(queue);
+        
+        for (const Event& ev : events) {
+            ScriptScheduler::signal(ev.id);
+            
+            auto it = subscribers.find(ev.id);
+            if (it == subscribers.end()) continue;
+            auto& subs = it->second;
+            for (size_t i = 0; i < subs.size();) {
+                // Drop subscriptions whose script was destroyed, reloaded or disabled
+                Script* sc = reg.scripts.get(subs[i].owner);
+                if (!sc || !sc->loaded || sc->disabled || sc->instance_serial != subs[i].serial) {
+                    subs[i] = std::move(subs.back());
+                    subs.pop_back();
+                    continue;
+                }
+                
+                // Handlers may subscribe, so call through a copy
+                sol::protected_function fn = subs[i].fn;
+                auto scope = enter_script(*sc);
+                ScriptWatchdog::arm();
+                std::string error;
+                bool ok = call(fn, ev, error);
+                if (ScriptWatchdog::disarm()) {
+                    ScriptWatchdog::disable(*sc);
+                } else if (!ok) {
+                    report_script_error(*sc, error);
+                }
+                ++i;
+            }
+        }
+    }
+    
+    static void clear() {
+        queue.clear();
+        subscribers.clear();
+    }
+};
+
+std::vector<EventBus::Event> EventBus::queue;
+std::unordered_map<uint32_t, std::vector<EventBus::Subscriber>> EventBus::subscribers;
+
+// One count hook serves both the watchdog and the sampling profiler. It is set
+// on the main state and every live coroutine; new coroutines inherit it.
+static const int SCRIPT_HOOK_INTERVAL = 1000; // Instructions between hook calls
+
+static void script_hook(lua_State* L, lua_Debug* ar) {
+    if (ar->event != LUA_HOOKCOUNT) return;
+    if (ScriptProfiler::enabled && ScriptProfiler::sampling) {
+        ScriptProfiler::sample(L);
+    }
+    ScriptWatchdog::check(L, SCRIPT_HOOK_INTERVAL);
+}
+
+static void install_script_hook(lua_State* L) {
+    bool on = ScriptWatchdog::active() || (ScriptProfiler::enabled && ScriptProfiler::sampling);
+    auto set = [&](lua_State* thread) {
+        if (on) {
+            lua_sethook(thread, script_hook, LUA_MASKCOUNT, SCRIPT_HOOK_INTERVAL);
+        } else {
+            lua_sethook(thread, nullptr, 0, 0);
+        }
+    };
+    set(L);
+    for (auto& co : ScriptScheduler::coroutines) {
+        if (co.thread.valid()) set(co.thread.thread_state());
+    }
+}
+
+// Prefab System: a prefab is a scene file holding one entity. spawn() reuses an
+// instance parked in the prefab's pool when there is one, otherwise it builds a
+// new one; despawn() parks the disabled Box2D body and the loaded script
+// instance instead of freeing them. Requests are queued and applied by flush()
+// once per step, after all script callbacks, so component arrays never change
+// under a running script. The entity id is reserved at spawn() time.
+struct PrefabSystem {
+    struct Parked {
+        Script script;
+        b2BodyId body;
+    };
+    
+    struct Prefab {
+        std::string path;
+        Registry tmpl; // Parsed prefab file; bodies are not created
+        EntityId root;
+        std::vector<Parked> pool;
+        uint32_t built = 0;
+        uint32_t reused = 0;
+    };
+    
+    struct SpawnRequest {
+        uint32_t prefab;
+        EntityId entity;
+        float x, y;
+    };
+    
+    static std::vector<Prefab> prefabs;
+    static std::unordered_map<std::string, uint32_t> prefab_index;
+    static std::unordered_map<EntityId, uint32_t> instances; // Live entity -> prefab
+    static std::vector<SpawnRequest> spawns;
+    static std::vector<EntityId> despawns;
+    static size_t max_pool; // Parked instances per prefab; 0 disables pooling
+    
+    static int find_prefab(const std::string& path) {
+        auto it = prefab_index.find(path);
+        if (it != prefab_index.end()) return (int)it->second;
+        
+        Prefab prefab;
+        prefab.path = path;
+        if (!SceneSerializer::load(path.c_str(), prefab.tmpl, b2_nullWorldId) || prefab.tmpl.transforms.entities.empty()) {
+            log_console("Failed to load prefab: " + path);
+            return -1;
+        }
+        prefab.root = prefab.tmpl.transforms.entities.front();
+        prefabs.push_back(std::move(prefab));
+        prefab_index[path] = (uint32_t)(prefabs.size() - 1);
+        return (int)(prefabs.size() - 1);
+    }
+    
+    static EntityId spawn(Registry& reg, const std::string& path, float x, float y) {
+        int index = find_prefab(path);
+        if (index < 0) return NULL_ENTITY;
+        EntityId e = reg.create();
+        spawns.push_back({(uint32_t)index, e, x, y});
+        return e;
+    }
+    
+    static void despawn(EntityId e) {
+        despawns.push_back(e);
+    }
+    
+    // Despawns run first, so a step that both despawns and spawns reuses instances
+    static void flush(Registry& reg, b2WorldId world, sol::state* lua) {
+        if (despawns.empty() && spawns.empty()) return;
+        std::vector<EntityId> parking;
+        parking.swap(despawns);
+        for (EntityId e : parking) {
+            park(reg, e);
+        }
+        std::vector<SpawnRequest> requests;
+        requests.swap(spawns);
+        for (const SpawnRequest& request : requests) {
+            if (reg.valid(request.entity)) {
+                build(reg, world, lua, request);
+            }
+        }
+    }
+    
+    static void park(Registry& reg, EntityId e) {
+        if (!reg.valid(e)) return;
+        auto it = instances.find(e);
+        if (it != instances.end()) {
+            Prefab& prefab = prefabs[it->second];
+            instances.erase(it);
+            
+            Rigidbody* rb = reg.rigidbodies.get(e);
+            Script* sc = reg.scripts.get(e);
+            if (prefab.pool.size() < max_pool) {
+                Parked parked;
+                parked.body = b2_nullBodyId;
+                if (rb && b2Body_IsValid(rb->body)) {
+                    b2Body_Disable(rb->body);
+                    parked.body = rb->body;
+                    rb->body = b2_nullBodyId;
+                }
+                if (sc && sc->loaded && !sc->disabled) {
+                    parked.script = std::move(*sc);
+                    parked.script.coroutine = UINT32_MAX; // the scheduler drops the old coroutine
+                }
+                prefab.pool.push_back(std::move(parked));
+            }
+        }
+        
+        // Anything not parked is freed with the entity
+        Rigidbody* rb = reg.rigidbodies.get(e);
+        if (rb && b2Body_IsValid(rb->body)) {
+            b2DestroyBody(rb->body);
+        }
+        reg.destroy(e);
+    }
+    
+    static void build(Registry& reg, b2WorldId world, sol::state* lua, const SpawnRequest& request) {
+        Prefab& prefab = prefabs[request.prefab];
+        Registry& tmpl = prefab.tmpl;
+        EntityId e = request.entity;
+        
+        Parked parked;
+        parked.body = b2_nullBodyId;
+        bool reuse = !prefab.pool.empty();
+        if (reuse) {
+            parked = std::move(prefab.pool.back());
+            prefab.pool.pop_back();
+            prefab.reused++;
+        } else {
+            prefab.built++;
+        }
+        
+        Transform t = *tmpl.transforms.get(prefab.root);
+        t.position = {request.x, request.y};
+        reg.transforms.add(e, t);
+        if (Sprite* sprite = tmpl.sprites.get(prefab.root)) {
+            reg.sprites.add(e, *sprite);
+        }
+        if (Tag* tag = tmpl.tags.get(prefab.root)) {
+            reg.set_tag(e, tag->value); // names are not copied; they identify a single entity
+        }
+        
+        if (Rigidbody* rb_tmpl = tmpl.rigidbodies.get(prefab.root)) {
+            Rigidbody rb = *rb_tmpl;
+            if (b2Body_IsValid(parked.body)) {
+                rb.body = parked.body;
+                b2Body_SetTransform(rb.body, b2Vec2{t.position.X, t.position.Y}, b2MakeRot(t.rotation));
+                b2Body_SetLinearVelocity(rb.body, b2Vec2{0.0f, 0.0f});
+                b2Body_SetAngularVelocity(rb.body, 0.0f);
+                b2Body_SetUserData(rb.body, (void*)(uintptr_t)(((uint64_t)e.generation << 32) | e.id));
+                b2Body_Enable(rb.body);
+            } else {
+                PhysicsSystem::create_body(reg, world, e, rb);
+            }
+            reg.rigidbodies.add(e, rb);
+        } else if (b2Body_IsValid(parked.body)) {
+            b2DestroyBody(parked.body);
+        }
+        
+        if (Script* sc_tmpl = tmpl.scripts.get(prefab.root)) {
+            Script sc;
+            if (parked.script.loaded) {
+                // Same closures and locals; on_spawn is where a script resets its state
+                sc = std::move(parked.script);
+                sc.entity = e;
+                sc.env["entity_id"] = e.id;
+                sc.env["entity_generation"] = e.generation;
+                sc.instance_serial = ++next_script_serial;
+                sc.env["_serial"] = sc.instance_serial;
+                if (sc.run_fn.valid() && sc.shard < 0) {
+                    ScriptScheduler::start(sc, e, lua);
+                }
+            } else {
+                sc.path = sc_tmpl->path;
+            }
+            sc.spawned = true;
+            reg.scripts.add(e, sc);
+        }
+        instances[e] = request.prefab;
+    }
+    
+    // Parked bodies live in the world and parked scripts in the Lua states, so
+    // this must run before either is destroyed. Ids reserved by spawns that were
+    // never built go back to the registry.
+    static void clear(Registry& reg) {
+        for (auto& prefab : prefabs) {
+            for (auto& parked : prefab.pool) {
+                if (b2Body_IsValid(parked.body)) b2DestroyBody(parked.body);
+            }
+        }
+        for (const SpawnRequest& request : spawns) reg.destroy(request.entity);
+        prefabs.clear(); // prefab files are read again on next use
+        prefab_index.clear();
+        instances.clear();
+        spawns.clear();
+        despawns.clear();
+    }
+};
+
+std::vector<PrefabSystem::Prefab> PrefabSystem::prefabs;
+std::unordered_map<std::string, uint32_t> PrefabSystem::prefab_index;
+std::unordered_map<EntityId, uint32_t> PrefabSystem::instances;
+std::vector<PrefabSystem::SpawnRequest> PrefabSystem::spawns;
+std::vector<EntityId> PrefabSystem::despawns;
+size_t PrefabSystem::max_pool = 256;
+
+// Entity lookup for scripts, shared by the main state and the shards. Only the
+// Registry indices are read, never component data.
+static void bind_entity_lookup(sol::state& lua, Registry* (*registry)()) {
+    lua.set_function("find_by_name", [registry](const std::string& name) -> sol::optional<std::tuple<uint32_t, uint32_t>> {
+        EntityId e = registry()->find_by_name(name);
+        if (e == NULL_ENTITY) return sol::nullopt;
+        return std::make_tuple(e.id, e.generation);
+    });
+    
+    // Iterates over a copy, so fn may destroy or retag entities
+    lua.set_function("each_with_tag", [registry](const std::string& tag, sol::protected_function fn) {
+        const std::vector<EntityId>* tagged = registry()->with_tag(tag);
+        if (!tagged) return;
+        std::vector<EntityId> entities = *tagged;
+        for (EntityId e : entities) {
+            sol::protected_function_result result = fn(e.id, e.generation);
+            if (!result.valid()) {
+                sol::error err = result;
+                throw err;
+            }
+        }
+    });
+    
+    lua.set_function("get_name", [registry](uint32_t id, uint32_t generation) -> sol::optional<std::string> {
+        Name* name = registry()->names.get({id, generation});
+        if (!name) return sol::nullopt;
+        return name->value;
+    });
+    
+    lua.set_function("get_tag", [registry](uint32_t id, uint32_t generation) -> sol::optional<std::string> {
+        Tag* tag = registry()->tags.get({id, generation});
+        if (!tag) return sol::nullopt;
+        return tag->value;
+    });
+}
+
+// Script Shards: scripts whose source starts with "--!parallel" promise to touch
+// only their own entity. With script_shards > 0 they run in separate Lua states,
+// one per worker thread, assigned by entity id. Inside a shard a script can read
+// and move its own transform directly; every other write (other entities,
+// physics, destroy, log, signal) is queued and applied on the main thread after
+// all workers finish, in shard order, so results don't depend on timing.
+struct ScriptShards {
+    struct Command {
+        enum Kind { SET_POSITION, SET_VELOCITY, APPLY_IMPULSE, DESTROY, LOG, EMIT, SPAWN, DESPAWN, SUBSCRIBE, UNSUBSCRIBE };
+        Kind kind;
+        EntityId entity;
+        float x, y;
+        std::string text;
+        EventBus::Event event;      // EMIT; SUBSCRIBE and UNSUBSCRIBE use only the id
+        uint32_t serial = 0;        // SUBSCRIBE
+        sol::protected_function fn; // SUBSCRIBE, a function of the shard's state
+    };
+    
+    struct Shard {
+        sol::state* lua = nullptr;
+        std::vector<std::pair<EntityId, float>> queued; // Due this step, with elapsed dt
+        std::vector<std::pair<Script*, float>> work;    // Resolved once the registry stops changing
+        std::vector<Command> commands;
+        std::vector<std::pair<Script*, std::string>> errors;
+        std::vector<Script*> aborted;
+    };
+    
+    static std::vector<Shard> shards;
+    static std::vector<std::thread> workers;
+    static std::mutex mutex;
+    static std::condition_variable start_cv;
+    static std::condition_variable done_cv;
+    static uint64_t generation;
+    static int pending;
+    static bool quit;
+    static Registry* registry; // Registry being updated; read-only to workers
+    static thread_local Shard* current_shard;
+    static thread_local EntityId current_entity;
+    
+    static int count() {
+        return (int)shards.size();
+    }
+    
+    static void seed(uint32_t seed) {
+        for (size_t i = 0; i < shards.size(); ++i) {
+            (*shards[i].lua)["math"]["randomseed"](seed + (uint32_t)i);
+        }
+    }
+    
+    static void create(int count) {
+        shutdown();
+        count = std::clamp(count, 0, (int)std::max(1u, std::thread::hardware_concurrency()));
+        shards.resize(count);
+        for (int i = 0; i < count; ++i) {
+            shards[i].lua = new sol::state();
+            bind(*shards[i].lua);
+            if (ScriptWatchdog::active()) {
+                lua_sethook(shards[i].lua->lua_state(), shard_hook, LUA_MASKCOUNT, SCRIPT_HOOK_INTERVAL);
+            }
+        }
+        quit = false;
+        for (int i = 0; i < count; ++i) {
+            workers.emplace_back(worker, i);
+        }
+    }
+    
+    // Scripts holding references into the shard states must be released first
+    static void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        start_cv.notify_all();
+        for (auto& w : workers) w.join();
+        workers.clear();
+        for (auto& shard : shards) delete shard.lua;
+        shards.clear();
+    }
+    
+    static void shard_hook(lua_State* L, lua_Debug* ar) {
+        if (ar->event != LUA_HOOKCOUNT) return;
+        ScriptWatchdog::check(L, SCRIPT_HOOK_INTERVAL);
+    }
+    
+    static bool owns(uint32_t id, uint32_t generation) {
+        return current_entity.id == id && current_entity.generation == generation;
+    }
+    
+    static void push(Command::Kind kind, EntityId e, float x = 0.0f, float y = 0.0f, std::string text = std::string()) {
+        current_shard->commands.push_back({kind, e, x, y, std::move(text), {}, 0, {}});
+    }
+    
+    // The shard API mirrors the main state's, restricted to the owning entity
+    static void bind(sol::state& lua) {
+        lua.open_libraries(sol::lib::base, sol::lib::math);
+        lua.set_function("get_key", &InputSystem::get_key);
+        lua.set_function("get_key_down", &InputSystem::get_key_down);
+        lua.set_function("get_mouse_pos", &InputSystem::get_mouse_position);
+        lua.set_function("get_mouse_button", &InputSystem::get_mouse_button);
+        
+        lua.set_function("get_transform", [](uint32_t id, uint32_t generation, sol::this_state ts) -> sol::optional<sol::table> {
+            Transform* t = owns(id, generation) ? registry->transforms.get({id, generation}) : nullptr;
+            if (!t) return sol::nullopt;
+            sol::table result = sol::state_view(ts).create_table();
+            result["x"] = t->position.X;
+            result["y"] = t->position.Y;
+            result["rotation"] = t->rotation;
+            return result;
+        });
+        lua.set_function("get_position", [](uint32_t id, uint32_t generation) -> sol::optional<std::tuple<float, float, float>> {
+            Transform* t = owns(id, generation) ? registry->transforms.get({id, generation}) : nullptr;
+            if (!t) return sol::nullopt;
+            return std::make_tuple(t->position.X, t->position.Y, t->rotation);
+        });
+        lua.set_function("set_transform", [](uint32_t id, uint32_t generation, float x, float y) {
+            if (owns(id, generation)) {
+                Transform* t = registry->transforms.get({id, generation});
+                if (t) {
+                    t->position.X = x;
+                    t->position.Y = y;
+                }
+            } else {
+                push(Command::SET_POSITION, {id, generation}, x, y);
+            }
+        });
+        
+        // Box2D is only read during the parallel phase; body writes are deferred
+        lua.set_function("get_linear_velocity", [](uint32_t id, uint32_t generation) -> sol::optional<std::tuple<float, float>> {
+            Rigidbody* rb = owns(id, generation) ? registry->rigidbodies.get({id, generation}) : nullptr;
+            if (!rb || !b2Body_IsValid(rb->body)) return sol::nullopt;
+            b2Vec2 vel = b2Body_GetLinearVelocity(rb->body);
+            return std::make_tuple(vel.x, vel.y);
+        });
+        lua.set_function("set_velocity", [](uint32_t id, uint32_t generation, float vx, float vy) {
+            push(Command::SET_VELOCITY, {id, generation}, vx, vy);
+        });
+        lua.set_function("apply_impulse", [](uint32_t id, uint32_t generation, float ix, float iy) {
+            push(Command::APPLY_IMPULSE, {id, generation}, ix, iy);
+        });
+        lua.set_function("destroy_entity", [](uint32_t id, uint32_t generation) {
+            push(Command::DESTROY, {id, generation});
+        });
+        lua.set_function("spawn", [](const std::string& prefab, float x, float y) {
+            push(Command::SPAWN, NULL_ENTITY, x, y, prefab); // no id is returned inside a shard
+        });
+        lua.set_function("despawn", [](uint32_t id, uint32_t generation) {
+            push(Command::DESPAWN, {id, generation});
+        });
+        lua.set_function("log", [](const std::string& msg) {
+            push(Command::LOG, NULL_ENTITY, 0.0f, 0.0f, msg);
+        });
+        bind_entity_lookup(lua, [] { return registry; });
+        EventBus::bind(lua, [](uint32_t id, const double* args, uint32_t argc) {
+            push(Command::EMIT, NULL_ENTITY);
+            EventBus::Event& ev = current_shard->commands.back().event;
+            ev.id = id;
+            ev.argc = std::min<uint32_t>(argc, EventBus::MAX_ARGS);
+            for (uint32_t i = 0; i < ev.argc; ++i) ev.args[i] = args[i];
+        }, [](uint32_t id, EntityId owner, uint32_t serial, sol::protected_function fn) {
+            push(Command::SUBSCRIBE, owner);
+            Command& cmd = current_shard->commands.back();
+            cmd.event.id = id;
+            cmd.serial = serial;
+            cmd.fn = std::move(fn);
+        }, [](uint32_t id, EntityId owner) {
+            push(Command::UNSUBSCRIBE, owner);
+            current_shard->commands.back().event.id = id;
+        });
+    }
+    
+    // Loading, on_spawn and event handlers of shard scripts run on the main thread with
+    // the shard's context; the previous context is restored when the scope ends
+    struct Scope {
+        Shard* shard;
+        EntityId entity;
+        
+        Scope(int index, EntityId e) : shard(current_shard), entity(current_entity) {
+            if (index < 0) return;
+            current_shard = &shards[index];
+            current_entity = e;
+        }
+        ~Scope() {
+            current_shard = shard;
+            current_entity = entity;
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+    
+    static void worker(int index) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start_cv.wait(lock, [&] { return quit || generation != seen; });
+                if (quit) return;
+                seen = generation;
+            }
+            run_shard(shards[index]);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0) done_cv.notify_one();
+            }
+        }
+    }
+    
+    static void run_shard(Shard& shard) {
+        current_shard = &shard;
+        for (auto& item : shard.work) {
+            Script& sc = *item.first;
+            current_entity = sc.entity;
+            ScriptWatchdog::arm();
+            sol::protected_function_result result = sc.update_fn(item.second);
+            if (ScriptWatchdog::disarm()) {
+                shard.aborted.push_back(&sc);
+            } else if (!result.valid()) {
+                sol::error err = result;
+                shard.errors.push_back({&sc, err.what()});
+            }
+        }
+        shard.work.clear();
+        current_shard = nullptr;
+        current_entity = NULL_ENTITY;
+    }
+    
+    // Runs the queued update calls on the workers and waits for all of them
+    static void run(Registry& reg) {
+        bool any = false;
+        for (auto& shard : shards) {
+            for (auto& item : shard.queued) {
+                Script* sc = reg.scripts.get(item.first);
+                if (sc && sc->loaded && sc->update_fn.valid()) shard.work.push_back({sc, item.second});
+            }
+            shard.queued.clear();
+            any = any || !shard.work.empty();
+        }
+        if (!any) {
+            apply(reg); // commands queued while loading
+            return;
+        }
+        
+        registry = &reg;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = count();
+            generation++;
+        }
+        start_cv.notify_all();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            done_cv.wait(lock, [] { return pending == 0; });
+        }
+        apply(reg);
+    }
+    
+    static void apply(Registry& reg) {
+        for (auto& shard : shards) {
+            for (auto& cmd : shard.commands) {
+                switch (cmd.kind) {
+                case Command::SET_POSITION:
+                    if (Transform* t = reg.transforms.get(cmd.entity)) {
+                        t->position.X = cmd.x;
+                        t->position.Y = cmd.y;
+                    }
+                    break;
+                case Command::SET_VELOCITY:
+                case Command::APPLY_IMPULSE:
+                    if (Rigidbody* rb = reg.rigidbodies.get(cmd.entity); rb && b2Body_IsValid(rb->body)) {
+                        if (cmd.kind == Command::SET_VELOCITY) {
+                            b2Body_SetLinearVelocity(rb->body, b2Vec2{cmd.x, cmd.y});
+                        } else {
+                            b2Body_ApplyLinearImpulseToCenter(rb->body, b2Vec2{cmd.x, cmd.y}, true);
+                        }
+                    }
+                    break;
+                case Command::DESTROY:
+                    if (reg.valid(cmd.entity)) {
+                        PhysicsSystem::destroy_entity(reg, cmd.entity);
+                        log_console("Entity " + std::to_string(cmd.entity.id) + " destroyed by script");
+                    }
+                    break;
+                case Command::LOG:
+                    log_console("[Lua] " + cmd.text);
+                    break;
+                case Command::EMIT:
+                    EventBus::emit(cmd.event.id, cmd.event.args, cmd.event.argc);
+                    break;
+                case Command::SPAWN:
+                    PrefabSystem::spawn(reg, cmd.text, cmd.x, cmd.y);
+                    break;
+                case Command::DESPAWN:
+                    PrefabSystem::despawn(cmd.entity);
+                    break;
+                case Command::SUBSCRIBE:
+                    EventBus::subscribe(cmd.event.id, cmd.entity, cmd.serial, std::move(cmd.fn));
+                    break;
+                case Command::UNSUBSCRIBE:
+                    EventBus::unsubscribe(cmd.event.id, cmd.entity);
+                    break;
+                }
+            }
+            shard.commands.clear();
+            
+            for (auto& err : shard.errors) report_script_error(*err.first, err.second);
+            shard.errors.clear();
+            for (Script* sc : shard.aborted) ScriptWatchdog::disable(*sc);
+            shard.aborted.clear();
+        }
+    }
+};
+
+std::vector<ScriptShards::Shard> ScriptShards::shards;
+std::vector<std::thread> ScriptShards::workers;
+std::mutex ScriptShards::mutex;
+std::condition_variable ScriptShards::start_cv;
+std::condition_variable ScriptShards::done_cv;
+uint64_t ScriptShards::generation = 0;
+int ScriptShards::pending = 0;
+bool ScriptShards::quit = false;
+Registry* ScriptShards::registry = nullptr;
+thread_local ScriptShards::Shard* ScriptShards::current_shard = nullptr;
+thread_local EntityId ScriptShards::current_entity = NULL_ENTITY;
+
+// Script System
+struct ScriptSystem {
+    static void load_script(Script& script, sol::state* lua, EntityId e, Registry& reg) {
+        if (script.path.empty() || script.loaded) return;
+        script.entity = e;
+        
+        // Each entity gets its own closure from the shared bytecode, so only the
+        // first entity using a path pays for parsing
+        const CompiledChunk* compiled = get_chunk(script.path, lua->lua_state());
+        if (!compiled) return;
+        const std::string* bytecode = &compiled->bytecode;
+        
+        // Parallel scripts load into their shard; load and init still run here
+        // on the main thread, with the shard's command queue
+        script.shard = -1;
+        if (compiled->parallel && ScriptShards::count() > 0) {
+            script.shard = (int)(e.id % (uint32_t)ScriptShards::count());
+            lua = ScriptShards::shards[script.shard].lua;
+        }
+        ScriptShards::Scope scope(script.shard, e);
+        
+        sol::load_result loaded_script = lua->load_buffer(bytecode->data(), bytecode->size(), "@" + script.path, sol::load_mode::binary);
+        if (!loaded_script.valid()) {
+            sol::error err = loaded_script;
+            log_console("Error loading script " + script.path + ": " + err.what());
+            return;
+        }
+        
+        // Create environment for this script with entity_id and generation
+        script.env = sol::environment(*lua, sol::create, lua->globals());
+        script.env["entity_id"] = e.id;
+        script.env["entity_generation"] = e.generation;
+        script.instance_serial = ++next_script_serial;
+        script.env["_serial"] = script.instance_serial;
+        
+        // Execute script in its own environment
+        sol::protected_function chunk = loaded_script;
+        sol::set_environment(script.env, chunk);
+        ScriptWatchdog::arm();
+        sol::protected_function_result result = chunk();
+        if (ScriptWatchdog::disarm()) {
+            ScriptWatchdog::disable(script);
+            return;
+        }
+        if (!result.valid()) {
+            sol::error err = result;
+            log_console("Error running script " + script.path + ": " + err.what());
+            return;
+        }
+        if (result.get_type() != sol::type::table) {
+            log_console("Error running script " + script.path + ": script must return a table");
+            return;
+        }
+        script.instance = result;
+        script.loaded = true;
+        script.error_reported = false;
+        script.profile_slot = ScriptProfiler::slot(script.path);
+        
+        resolve_tick_rate(script);
+        
+        // Resolve callbacks once; update_scripts only calls the cached functions
+        script.init_fn = resolve_callback(script, "init");
+        script.update_fn = resolve_callback(script, "update");
+        script.run_fn = resolve_callback(script, "run");
+        script.on_spawn_fn = resolve_callback(script, "on_spawn");
+        
+        if (script.init_fn.valid()) {
+            ScriptWatchdog::arm();
+            sol::protected_function_result init_result = script.init_fn();
+            if (ScriptWatchdog::disarm()) {
+                ScriptWatchdog::disable(script);
+                return;
+            }
+            if (!init_result.valid()) {
+                report_error(script, init_result);
+            }
+        }
+        if (script.run_fn.valid()) {
+            if (script.shard >= 0) {
+                log_console("Script " + script.path + ": run coroutines are not supported in parallel scripts");
+            } else {
+                ScriptScheduler::start(script, e, lua);
+            }
+        }
+    }
+    
+    static constexpr const char* BYTECODE_CACHE_DIR = ".3kcache/lua";
+    
+    // Compiled bytecode per script path, recompiled when the file changes
+    struct CompiledChunk {
+        std::string bytecode;
+        PHYSFS_sint64 modtime;
+        bool parallel; // Source starts with "--!parallel", see ScriptShards
+    };
+    static std::unordered_map<std::string, CompiledChunk> chunk_cache;
+    
+    static int write_chunk(lua_State*, const void* p, size_t size, void* ud) {
+        ((std::string*)ud)->append((const char*)p, size);
+        return 0;
+    }
+    
+    static const CompiledChunk* get_chunk(const std::string& path, lua_State* L) {
+        PHYSFS_Stat stat;
+        if (!PHYSFS_stat(path.c_str(), &stat)) return nullptr;
+        
+        auto it = chunk_cache.find(path);
+        if (it != chunk_cache.end() && it->second.modtime == stat.modtime) {
+            return &it->second;
+        }
+        
+        PHYSFS_File* file = PHYSFS_openRead(path.c_str());
+        if (!file) return nullptr;
+        
+        PHYSFS_sint64 filesize = PHYSFS_fileLength(file);
+        if (filesize <= 0) { PHYSFS_close(file); return nullptr; }
+        
+        std::vector<char> buffer(filesize);
+        PHYSFS_readBytes(file, buffer.data(), filesize);
+        PHYSFS_close(file);
+        
+        CompiledChunk& chunk = chunk_cache[path];
+        chunk.bytecode.clear();
+        chunk.modtime = stat.modtime;
+        chunk.parallel = filesize >= 11 && memcmp(buffer.data(), "--!parallel", 11) == 0;
+        
+        // The source is only parsed when no matching cache file exists
+        std::string cache_path = bytecode_cache_path(path, buffer.data(), buffer.size());
+        if (read_cached_bytecode(cache_path.c_str(), L, chunk.bytecode)) {
+            return &chunk;
+        }
+        
+        std::string chunkname = "@" + path;
+        if (luaL_loadbufferx(L, buffer.data(), (size_t)filesize, chunkname.c_str(), "t") != LUA_OK) {
+            log_console("Error loading script " + path + ": " + lua_tostring(L, -1));
+            lua_pop(L, 1);
+            chunk_cache.erase(path);
+            return nullptr;
+        }
+        lua_dump(L, write_chunk, &chunk.bytecode, 0);
+        lua_pop(L, 1);
+        write_cached_bytecode(cache_path.c_str(), chunk.bytecode);
+        return &chunk;
+    }
+    
+    // Bytecode on disk is keyed by path and source hash
+    static std::string bytecode_cache_path(const std::string& path, const char* source, size_t size) {
+        uint64_t key = hash_bytes(source, size, hash_bytes(path.data(), path.size()));
+        char cache_path[64];
+        snprintf(cache_path, sizeof(cache_path), "%s/%016llx.luac", BYTECODE_CACHE_DIR, (unsigned long long)key);
+        return cache_path;
+    }
+    
+    static bool read_cached_bytecode(const char* cache_path, lua_State* L, std::string& bytecode) {
+        PHYSFS_File* file = PHYSFS_openRead(cache_path);
+        if (!file) return false;
+        
+        PHYSFS_sint64 filesize = PHYSFS_fileLength(file);
+        if (filesize > 0) {
+            bytecode.resize((size_t)filesize);
+            PHYSFS_readBytes(file, bytecode.data(), filesize);
+        }
+        PHYSFS_close(file);
+        
+        // Reject bytecode from another Lua version or a truncated write
+        if (bytecode.empty() || luaL_loadbufferx(L, bytecode.data(), bytecode.size(), cache_path, "b") != LUA_OK) {
+            if (!bytecode.empty()) lua_pop(L, 1);
+            bytecode.clear();
+            return false;
+        }
+        lua_pop(L, 1);
+        return true;
+    }
+    
+    static void write_cached_bytecode(const char* cache_path, const std::string& bytecode) {
+        std::error_code ec;
+        std::filesystem::create_directories(BYTECODE_CACHE_DIR, ec);
+        
+        // Write to a temporary file and rename, so a reader never sees a partial file
+        std::string tmp_path = std::string(cache_path) + ".tmp";
+        {
+            std::ofstream file(tmp_path, std::ios::binary);
+            if (!file.is_open()) return;
+            file.write(bytecode.data(), (std::streamsize)bytecode.size());
+            if (!file.good()) return;
+        }
+        std::filesystem::rename(tmp_path, cache_path, ec);
+    }
+    
+    static sol::protected_function resolve_callback(Script& script, const char* name) {
+        sol::object fn = script.instance[name];
+        if (fn.get_type() != sol::type::function) return sol::protected_function();
+        return fn.as<sol::protected_function>();
+    }
+    
+    // Scripts may declare how often update runs:
+    //   update_interval = 4                  -- every 4th step
+    //   update_rate = 10                     -- 10 times per second
+    //   update_lod = { {300, 1}, {800, 4} }  -- interval by distance to the camera,
+    //                                        -- the last entry applies beyond its distance
+    static void resolve_tick_rate(Script& script) {
+        script.update_interval = std::max(1, script.instance.get_or("update_interval", 1));
+        script.update_rate = std::max(0.0f, script.instance.get_or("update_rate", 0.0f));
+        script.update_lod.clear();
+        sol::optional<sol::table> lod = script.instance["update_lod"];
+        if (lod) {
+            for (size_t i = 1; i <= lod->size(); ++i) {
+                sol::optional<sol::table> tier = (*lod)[i];
+                if (!tier) continue;
+                float distance = tier->get_or(1, 0.0f);
+                int interval = std::max(1, tier->get_or(2, 1));
+                script.update_lod.push_back({distance, (uint32_t)interval});
+            }
+            std::sort(script.update_lod.begin(), script.update_lod.end());
+        }
+        
+        // Consecutive phases per interval put its scripts into evenly sized groups, one
+        // group per step. LOD and rate intervals are only known while running, so those
+        // scripts take their phase from the entity id, which is as evenly spread.
+        if (script.update_lod.empty() && script.update_rate <= 0.0f) {
+            script.tick_phase = next_phase[script.update_interval]++;
+        } else {
+            script.tick_phase = script.entity.id;
+        }
+        script.last_tick = tick;
+    }
+    
+    static uint32_t tick_interval(const Script& script, EntityId e, Registry& reg, float dt, const HMM_Vec2* camera) {
+        if (!script.update_lod.empty()) {
+            Transform* t = reg.transforms.get(e);
+            if (!camera || !t) return script.update_lod.front().second;
+            float distance = HMM_LenV2(HMM_SubV2(t->position, *camera));
+            for (const auto& tier : script.update_lod) {
+                if (distance <= tier.first) return tier.second;
+            }
+            return script.update_lod.back().second;
+        }
+        if (script.update_rate > 0.0f) {
+            return std::max(1u, (uint32_t)std::lround(1.0f / (script.update_rate * dt)));
+        }
+        return script.update_interval;
+    }
+    
+    // First camera in the scene; LOD distances are measured from its view center
+    static bool camera_position(Registry& reg, HMM_Vec2& out) {
+        for (size_t i = 0; i < reg.cameras.entities.size(); ++i) {
+            Transform* t = reg.transforms.get(reg.cameras.entities[i]);
+            if (!t) continue;
+            out = HMM_AddV2(t->position, reg.cameras.components[i].offset);
+            return true;
+        }
+        return false;
+    }
+    
+    static uint64_t tick; // Fixed steps run by update_scripts
+    static std::unordered_map<uint32_t, uint32_t> next_phase; // By update_interval
+    
+    static void reset_ticks() {
+        tick = 0;
+        next_phase.clear();
+    }
+    
+    static void report_error(Script& script, const sol::protected_function_result& result) {
+        sol::error err = result;
+        report_script_error(script, err.what());
+    }
+    
+    static void update_scripts(Registry& reg, sol::state* lua, float dt) {
+        tick++;
+        ScriptShards::registry = &reg;
+        HMM_Vec2 camera;
+        bool has_camera = camera_position(reg, camera);
+        
+        reg.scripts.each([&](EntityId e, Script& sc) {
+            if (!sc.loaded && !sc.disabled && !sc.path.empty()) {
+                load_script(sc, lua, e, reg);
+                sc.last_tick = tick - 1;
+            }
+            if (sc.spawned && sc.loaded) {
+                sc.spawned = false;
+                if (sc.on_spawn_fn.valid()) {
+                    ScriptShards::Scope scope(sc.shard, sc.entity);
+                    ScriptWatchdog::arm();
+                    sol::protected_function_result result = sc.on_spawn_fn();
+                    if (ScriptWatchdog::disarm()) {
+                        ScriptWatchdog::disable(sc);
+                        return;
+                    }
+                    if (!result.valid()) {
+                        report_error(sc, result);
+                    }
+                }
+            }
+            
+            if (sc.loaded && sc.update_fn.valid()) {
+                uint32_t interval = tick_interval(sc, e, reg, dt, has_camera ? &camera : nullptr);
+                if (interval > 1 && (tick + sc.tick_phase) % interval != 0) return;
+                
+                // Skipped steps are folded into dt
+                float elapsed = dt * (float)(tick - sc.last_tick);
+                sc.last_tick = tick;
+                
+                if (sc.shard >= 0) {
+                    ScriptShards::shards[sc.shard].queued.push_back({e, elapsed});
+                    return;
+                }
+                
+                auto t0 = ScriptProfiler::enabled ? ScriptProfiler::begin() : ScriptProfiler::Clock::time_point();
+                ScriptWatchdog::arm();
+                sol::protected_function_result result = sc.update_fn(elapsed);
+                bool aborted = ScriptWatchdog::disarm();
+                if (ScriptProfiler::enabled) ScriptProfiler::end(sc.profile_slot, t0);
+                if (aborted) {
+                    ScriptWatchdog::disable(sc);
+                } else if (!result.valid()) {
+                    report_error(sc, result);
+                }
+            }
+        });
+        
+        ScriptShards::run(reg);
+    }
+};
+
+std::unordered_map<std::string, ScriptSystem::CompiledChunk> ScriptSystem::chunk_cache;
+uint64_t ScriptSystem::tick = 0;
+std::unordered_map<uint32_t, uint32_t> ScriptSystem::next_phase;
+
+// Lua GC: the automatic collector is stopped and driven in a time-budgeted
+// slice at the end of each frame, so collection work never lands inside
+// update_scripts
+struct ScriptGC {
+    static bool manual;
+    static bool generational;
+    static float budget_ms;
+    static size_t cycle_memory_kb; // Heap size when the last cycle finished
+    static bool in_cycle;
+    
+    // Statistics
+    static float last_slice_ms;
+    static float max_slice_ms;
+    static double total_ms;
+    static uint32_t slices;
+    static uint32_t cycles;
+    static uint32_t forced;
+    
+    static void configure(lua_State* L, const ProjectSettings& settings) {
+        generational = settings.lua_gc_generational;
+        budget_ms = settings.lua_gc_budget_ms;
+        manual = budget_ms > 0.0f;
+        if (generational) {
+            lua_gc(L, LUA_GCGEN, 0, 0);
+        } else {
+            lua_gc(L, LUA_GCINC, 0, 0, 0);
+        }
+        if (manual) {
+            lua_gc(L, LUA_GCSTOP);
+        }
+        cycle_memory_kb = (size_t)lua_gc(L, LUA_GCCOUNT);
+        in_cycle = false;
+        reset_stats();
+    }
+    
+    static void reset_stats() {
+        last_slice_ms = max_slice_ms = 0.0f;
+        total_ms = 0.0;
+        slices = cycles = forced = 0;
+    }
+    
+    static void step(lua_State* L) {
+        if (!manual) return;
+        
+        auto t0 = std::chrono::steady_clock::now();
+        auto elapsed_ms = [&]() {
+            return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        };
+        
+        // Like Lua's own pause, a new cycle (or young collection) only starts once
+        // the heap has grown enough since the last one
+        size_t memory_kb = (size_t)lua_gc(L, LUA_GCCOUNT);
+        if (!in_cycle) {
+            size_t threshold = generational ? cycle_memory_kb + cycle_memory_kb / 5 : cycle_memory_kb * 2;
+            if (memory_kb < threshold) {
+                last_slice_ms = 0.0f;
+                return;
+            }
+        }
+        
+        // If allocation outpaces the budget, finish the cycle regardless so the heap stays bounded
+        bool force = memory_kb > std::max<size_t>(cycle_memory_kb * 4, 1024);
+        if (force) forced++;
+        
+        bool finished = false;
+        if (generational) {
+            // Each step is one young collection (or a major one when Lua decides)
+            lua_gc(L, LUA_GCSTEP, 0);
+            finished = true;
+        } else {
+            do {
+                finished = lua_gc(L, LUA_GCSTEP, 0) != 0;
+            } while (!finished && (force || elapsed_ms() < budget_ms));
+        }
+        in_cycle = !finished;
+        if (finished) {
+            cycles++;
+            cycle_memory_kb = (size_t)lua_gc(L, LUA_GCCOUNT);
+        }
+        
+        last_slice_ms = elapsed_ms();
+        max_slice_ms = std::max(max_slice_ms, last_slice_ms);
+        total_ms += last_slice_ms;
+        slices++;
+    }
+    
+    static size_t memory_kb(lua_State* L) {
+        return (size_t)lua_gc(L, LUA_GCCOUNT);
+    }
+};
+
+bool ScriptGC::manual = false;
+bool ScriptGC::generational = false;
+float ScriptGC::budget_ms = 0.0f;
+size_t ScriptGC::cycle_memory_kb = 0;
+bool ScriptGC::in_cycle = false;
+float ScriptGC::last_slice_ms = 0.0f;
+float ScriptGC::max_slice_ms = 0.0f;
+double ScriptGC::total_ms = 0.0;
+uint32_t ScriptGC::slices = 0;
+uint32_t ScriptGC::cycles = 0;
+uint32_t ScriptGC::forced = 0;
+
+// Texture Atlas: sprite textures packed into a few large pages with stb_rect_pack, so
+// the viewport draws a scene with one texture bind per page instead of one per texture.
+// Pages keep their pixels on the CPU and pack incrementally as textures finish
+// decoding; dirty pages are re-uploaded once per frame by flush(). Textures larger than
+// MAX_SIZE are drawn from their own image. Skyline packing can't free single rects, so
+// a page is only reused once every texture on it has been evicted.
+struct TextureAtlas {
+    static constexpr int PAGE_SIZE = 2048;
+    static constexpr int MAX_SIZE = 512;
+    static constexpr int PADDING = 1; // Empty texels around each texture against bleeding
+    
+    struct Page {
+        sg_image image = {SG_INVALID_ID};
+        sg_view view = {SG_INVALID_ID};
+        std::vector<uint8_t> pixels;
+        std::vector<stbrp_node> nodes;
+        stbrp_context context; // Points into nodes and itself, so pages never move
+        int live = 0;          // Regions on the page
+        bool dirty = false;
+    };
+    
+    // Where a texture is drawn from
+    struct Region {
+        ImTextureID texture = 0;
+        ImVec2 uv0, uv1;
+        int page = -1;                  // -1 outside the atlas
+        sg_view view = {SG_INVALID_ID}; // Own view for textures outside the atlas
+    };
+    
+    static std::deque<Page> pages;
+    static Region white; // Solid texels for untextured sprites, so they batch with textured ones
+    
+    static Page& add_page() {
+        Page& page = pages.emplace_back();
+        page.pixels.assign((size_t)PAGE_SIZE * PAGE_SIZE * 4, 0);
+        page.nodes.resize(PAGE_SIZE);
+        stbrp_init_target(&page.context, PAGE_SIZE, PAGE_SIZE, page.nodes.data(), (int)page.nodes.size());
+        
+        sg_image_desc img_desc = {};
+        img_desc.width = PAGE_SIZE;
+        img_desc.height = PAGE_SIZE;
+        img_desc.pixel_format = SG_PIXELFORMAT_RGBA8;
+        img_desc.usage.dynamic_update = true;
+        img_desc.label = "sprite-atlas";
+        page.image = sg_make_image(&img_desc);
+        sg_view_desc view_desc = {};
+        view_desc.texture.image = page.image;
+        page.view = sg_make_view(&view_desc);
+        page.dirty = true;
+        return page;
+    }
+    
+    // Packs a w x h block into the first page with room and returns the page index and
+    // texel origin, or -1
+    static int allocate(int w, int h, int& x, int& y) {
+        stbrp_rect rect = {};
+        rect.w = w + PADDING * 2;
+        rect.h = h + PADDING * 2;
+        for (size_t i = 0; i <= pages.size(); ++i) {
+            Page& candidate = i < pages.size() ? pages[i] : add_page();
+            if (stbrp_pack_rects(&candidate.context, &rect, 1) && rect.was_packed) {
+                candidate.live++;
+                x = rect.x + PADDING;
+                y = rect.y + PADDING;
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+    
+    static ImVec2 uv(int x, int y) {
+        return ImVec2((float)x / PAGE_SIZE, (float)y / PAGE_SIZE);
+    }
+    
+    static const Region& white_region() {
+        if (white.texture == 0) {
+            constexpr int SIZE = 4;
+            int x, y;
+            Page* page = &pages[allocate(SIZE, SIZE, x, y)];
+            for (int row = 0; row < SIZE; ++row) {
+                memset(&page->pixels[((size_t)(y + row) * PAGE_SIZE + x) * 4], 0xFF, SIZE * 4);
+            }
+            // Sample the middle so filtering never reaches the padding
+            white.texture = simgui_imtextureid(page->view);
+            white.uv0 = uv(x + 1, y + 1);
+            white.uv1 = uv(x + SIZE - 1, y + SIZE - 1);
+        }
+        return white;
+    }
+    
+    // Called with a texture's pixels once its image is initialized
+    static Region add(sg_image handle, const uint8_t* pixels, int width, int height) {
+        Region region;
+        int x = 0, y = 0;
+        int index = width > MAX_SIZE || height > MAX_SIZE ? -1 : allocate(width, height, x, y);
+        if (index < 0) {
+            sg_view_desc view_desc = {};
+            view_desc.texture.image = handle;
+            region.view = sg_make_view(&view_desc);
+            region.texture = simgui_imtextureid(region.view);
+            region.uv0 = ImVec2(0.0f, 0.0f);
+            region.uv1 = ImVec2(1.0f, 1.0f);
+        } else {
+            Page* page = &pages[index];
+            for (int row = 0; row < height; ++row) {
+                memcpy(&page->pixels[((size_t)(y + row) * PAGE_SIZE + x) * 4], pixels + (size_t)row * width * 4,
+                       (size_t)width * 4);
+            }
+            page->dirty = true;
+            region.texture = simgui_imtextureid(page->view);
+            region.uv0 = uv(x, y);
+            region.uv1 = uv(x + width, y + height);
+            region.page = index;
+        }
+        return region;
+    }
+    
+    static void remove(Region& region) {
+        if (region.view.id != SG_INVALID_ID) sg_destroy_view(region.view);
+        if (region.page >= 0 && region.page < (int)pages.size() && --pages[region.page].live == 0) {
+            Page& page = pages[region.page];
+            stbrp_init_target(&page.context, PAGE_SIZE, PAGE_SIZE, page.nodes.data(), (int)page.nodes.size());
+            std::fill(page.pixels.begin(), page.pixels.end(), 0);
+        }
+        region = Region();
+    }
+    
+    // Re-uploads pages changed since the last frame
+    static void flush() {
+        for (Page& page : pages) {
+            if (!page.dirty) continue;
+            sg_image_data data = {};
+            data.mip_levels[0] = {page.pixels.data(), page.pixels.size()};
+            sg_update_image(page.image, &data);
+            page.dirty = false;
+        }
+    }
+    
+    // Regions and their views belong to AssetManager, which removes them first
+    static void cleanup() {
+        for (Page& page : pages) {
+            sg_destroy_view(page.view);
+            sg_destroy_image(page.image);
+        }
+        pages.clear();
+        white = Region();
+    }
+};
+
+std::deque<TextureAtlas::Page> TextureAtlas::pages;
+TextureAtlas::Region TextureAtlas::white;
+
+// Asset Manager
+struct AssetManager {
+    // One slot per TextureRef::counts entry. Sprites reach their texture by slot index;
+    // the path map is only consulted when a texture is requested.
+    struct Texture {
+        std::string path;
+        sg_image image = {SG_INVALID_ID}; // Allocated until the upload
+        size_t bytes = 0;                 // GPU image plus its atlas copy
+        TextureAtlas::Region region;
+    };
+    static std::vector<Texture> textures;
+    static std::vector<uint32_t> free_slots;
+    static std::unordered_map<std::string, uint32_t> slots_by_path;
+    static size_t resident_bytes;
+    
+    // Texture already decoded by AssetPack or the texture cache: this header, then
+    // width * height RGBA8 pixels. Packs store it under the original image path, told
+    // apart from PNG/JPEG by the magic.
+    static constexpr char TEXTURE_MAGIC[4] = {'3', 'K', 'T', 'X'};
+    static constexpr const char* TEXTURE_CACHE_DIR = ".3kcache/textures";
+    struct TextureHeader {
+        char magic[4];
+        uint32_t width;
+        uint32_t height;
+    };
+    
+    static bool encode_texture(const uint8_t* data, size_t size, std::string& out) {
+        int width, height, channels;
+        stbi_uc* pixels = stbi_load_from_memory(data, (int)size, &width, &height, &channels, 4);
+        if (!pixels) return false;
+        TextureHeader header;
+        memcpy(header.magic, TEXTURE_MAGIC, 4);
+        header.width = (uint32_t)width;
+        header.height = (uint32_t)height;
+        out.assign((const char*)&header, sizeof(header));
+        out.append((const char*)pixels, (size_t)width * height * 4);
+        stbi_image_free(pixels);
+        return true;
+    }
+    
+    // Decoded RGBA8 pixels, pointing into the preprocessed texture held in file
+    struct Image {
+        std::string path;
+        uint32_t slot = 0;
+        uint32_t generation = 0;
+        int width = 0;
+        int height = 0;
+        const uint8_t* pixels = nullptr;
+        std::string file;
+        bool cached = false; // Read from the texture cache instead of decoded
+    };
+    
+    static bool is_preprocessed(const std::string& data) {
+        return data.size() >= sizeof(TextureHeader) && memcmp(data.data(), TEXTURE_MAGIC, 4) == 0;
+    }
+    
+    static bool parse(Image& image) {
+        TextureHeader header;
+        memcpy(&header, image.file.data(), sizeof(header));
+        image.width = (int)header.width;
+        image.height = (int)header.height;
+        if (image.file.size() != sizeof(header) + (size_t)header.width * header.height * 4) return false;
+        image.pixels = (const uint8_t*)image.file.data() + sizeof(header);
+        return true;
+    }
+    
+    // Decoded textures are cached by content hash, so the pixels of an unchanged image
+    // are read back in one go instead of decoded again. The key includes the format
+    // version, and a renamed or moved image still hits.
+    static std::string texture_cache_path(const std::string& data) {
+        static constexpr uint32_t FORMAT_VERSION = 1;
+        uint64_t key = hash_bytes(data.data(), data.size(), hash_bytes(&FORMAT_VERSION, sizeof(FORMAT_VERSION)));
+        char cache_path[64];
+        snprintf(cache_path, sizeof(cache_path), "%s/%016llx.3ktex", TEXTURE_CACHE_DIR, (unsigned long long)key);
+        return cache_path;
+    }
+    
+    // Cache writes use a temp file per worker thread; a crash mid-write leaves one
+    // behind, so they are removed before the first worker starts
+    static void sweep_cache_temps() {
+        std::error_code ec;
+        for (std::filesystem::directory_iterator it(TEXTURE_CACHE_DIR, ec), end; !ec && it != end; it.increment(ec)) {
+            if (it->path().extension() == ".tmp") std::filesystem::remove(it->path(), ec);
+        }
+    }
+    
+    static bool decode(Image& image) {
+        if (!SceneSerializer::read_file(image.path.c_str(), image.file)) return false;
+        if (is_preprocessed(image.file)) return parse(image);
+        
+        std::string cache_path = texture_cache_path(image.file);
+        std::string data;
+        if (SceneSerializer::read_file(cache_path.c_str(), data) && is_preprocessed(data)) {
+            std::swap(image.file, data);
+            if (parse(image)) {
+                image.cached = true;
+                return true;
+            }
+            std::swap(image.file, data); // Truncated or stale, decode again
+        }
+        
+        if (!encode_texture((const uint8_t*)image.file.data(), image.file.size(), data)) return false;
+        image.file = std::move(data);
+        std::error_code ec;
+        std::filesystem::create_directories(TEXTURE_CACHE_DIR, ec);
+        SceneSerializer::write_file(cache_path.c_str(), image.file);
+        return parse(image);
+    }
+    
+    // Textures load asynchronously: the slot's image is only allocated, and reads and
+    // decodes run on worker threads. update() initializes it with the decoded pixels on
+    // the main thread, so sprites holding the reference see the texture once state()
+    // reports it valid. Returns an empty reference for missing files.
+    static TextureRef load_texture(const char* path) {
+        auto it = slots_by_path.find(path);
+        if (it != slots_by_path.end()) {
+            return TextureRef(it->second, TextureRef::counts[it->second].generation);
+        }
+        std::error_code ec;
+        if (!PHYSFS_exists(path) && !std::filesystem::is_regular_file(path, ec)) return TextureRef();
+        
+        uint32_t slot;
+        if (!free_slots.empty()) {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        } else {
+            slot = (uint32_t)textures.size();
+            textures.emplace_back();
+            TextureRef::counts.emplace_back();
+        }
+        Texture& texture = textures[slot];
+        texture.path = path;
+        texture.image = sg_alloc_image();
+        slots_by_path[path] = slot;
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        if (workers.empty()) {
+            sweep_cache_temps();
+            unsigned count = std::clamp(std::thread::hardware_concurrency(), 2u, 5u) - 1;
+            for (unsigned i = 0; i < count; ++i) workers.emplace_back(run);
+        }
+        Image& job = requests.emplace_back();
+        job.path = path;
+        job.slot = slot;
+        job.generation = TextureRef::counts[slot].generation;
+        wake.notify_one();
+        return TextureRef(slot, job.generation);
+    }
+    
+    static sg_resource_state state(const TextureRef& ref) {
+        return ref.valid() ? sg_query_image_state(textures[ref.index].image) : SG_RESOURCESTATE_INVALID;
+    }
+    
+    // The texture to draw a reference with, null until it is uploaded
+    static const Texture* use(const TextureRef& ref) {
+        if (!ref.valid()) return nullptr;
+        Texture& texture = textures[ref.index];
+        return texture.region.texture != 0 ? &texture : nullptr;
+    }
+    
+    static void free_slot(uint32_t slot) {
+        Texture& texture = textures[slot];
+        if (sg_query_image_state(texture.image) == SG_RESOURCESTATE_ALLOC) {
+            sg_dealloc_image(texture.image);
+        } else {
+            sg_destroy_image(texture.image);
+        }
+        TextureAtlas::remove(texture.region);
+        resident_bytes -= texture.bytes;
+        slots_by_path.erase(texture.path);
+        texture = Texture();
+        
+        // Outstanding references go stale
+        TextureRef::unlink_idle(slot);
+        TextureRef::Count& count = TextureRef::counts[slot];
+        count.generation++;
+        count.refs = 0;
+        free_slots.push_back(slot);
+    }
+    
+    // Unreferenced textures, least recently released first, until the budget is met.
+    // Ones still loading stay linked and are skipped.
+    static void evict(size_t budget_bytes) {
+        uint32_t slot = TextureRef::idle_head;
+        while (resident_bytes > budget_bytes && slot != UINT32_MAX) {
+            uint32_t next = TextureRef::counts[slot].next;
+            if (textures[slot].bytes != 0) {
+                log_console("Texture evicted: " + textures[slot].path);
+                free_slot(slot);
+            }
+            slot = next;
+        }
+    }
+    
+    static void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [] { return stopping || !requests.empty(); });
+            if (stopping) return;
+            Image image = std::move(requests.front());
+            requests.pop_front();
+            decoding++;
+            
+            lock.unlock();
+            bool ok = decode(image);
+            lock.lock();
+            
+            decoding--;
+            if (!ok) image.pixels = nullptr;
+            ready.push_back(std::move(image));
+        }
+    }
+    
+    // Uploads decoded textures for up to budget_ms, at least one per call, then evicts
+    // down to budget_mb
+    static void update(float budget_ms, float budget_mb) {
+        auto start = std::chrono::steady_clock::now();
+        for (;;) {
+            Image image;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (ready.empty()) break;
+                image = std::move(ready.front());
+                ready.pop_front();
+            }
+            
+            // Skip textures evicted or cleared while decoding
+            if (TextureRef::counts[image.slot].generation != image.generation) continue;
+            Texture& texture = textures[image.slot];
+            if (image.pixels) {
+                sg_image_desc img_desc = {};
+                img_desc.width = image.width;
+                img_desc.height = image.height;
+                img_desc.pixel_format = SG_PIXELFORMAT_RGBA8;
+                img_desc.data.mip_levels[0].ptr = image.pixels;
+                img_desc.data.mip_levels[0].size = (size_t)image.width * image.height * 4;
+                sg_init_image(texture.image, &img_desc);
+                texture.region = TextureAtlas::add(texture.image, image.pixels, image.width, image.height);
+                texture.bytes = (size_t)image.width * image.height * 4 * (texture.region.page >= 0 ? 2 : 1);
+                resident_bytes += texture.bytes;
+                log_console("Texture loaded: " + image.path + (image.cached ? " (cached)" : ""));
+            } else {
+                log_console("Failed to load texture: " + image.path);
+                free_slot(image.slot);
+            }
+            
+            double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (elapsed >= budget_ms) break;
+        }
+        evict((size_t)((double)budget_mb * 1024.0 * 1024.0));
+    }
+    
+    // Textures requested but not uploaded yet
+    static size_t loading() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return requests.size() + (size_t)decoding + ready.size();
+    }
+    
+    static void cleanup() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            requests.clear();
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers) worker.join();
+        workers.clear();
+        ready.clear();
+        stopping = false;
+        
+        for (uint32_t i = 0; i < (uint32_t)textures.size(); ++i) {
+            if (textures[i].image.id != SG_INVALID_ID) free_slot(i);
+        }
+    }
+    
+    static std::vector<std::thread> workers;
+    static std::mutex mutex;
+    static std::condition_variable wake;
+    static std::deque<Image> requests;
+    static std::deque<Image> ready;
+    static int decoding;
+    static bool stopping;
+};
+
+std::vector<AssetManager::Texture> AssetManager::textures;
+std::vector<uint32_t> AssetManager::free_slots;
+std::unordered_map<std::string, uint32_t> AssetManager::slots_by_path;
+size_t AssetManager::resident_bytes = 0;
+std::vector<std::thread> AssetManager::workers;
+std::mutex AssetManager::mutex;
+std::condition_variable AssetManager::wake;
+std::deque<AssetManager::Image> AssetManager::requests;
+std::deque<AssetManager::Image> AssetManager::ready;
+int AssetManager::decoding = 0;
+bool AssetManager::stopping = false;
+
+// Asset Pack: scenes, scripts and textures bundled into one archive, so a shipped game
+// opens one file instead of thousands of loose ones. The archive is an uncompressed ZIP,
+// which PhysFS mounts natively and whose central directory is the table of contents.
+// Packing converts text scenes and prefabs to the binary scene format, adds each script's
+// bytecode cache entry next to its source and stores images decoded (see
+// AssetManager::TEXTURE_MAGIC). Packs are mounted after the working directory, so loose
+// files override them during development.
+struct AssetPack {
+    static constexpr const char* EXTENSION = ".3kpak";
+    
+    struct Entry {
+        std::string path;
+        uint32_t crc;
+        uint32_t size;
+        uint32_t offset;
+    };
+    
+    struct Stats {
+        size_t files = 0;
+        size_t scenes = 0;
+        size_t scripts = 0;
+        size_t textures = 0;
+    };
+    
+    // The directory itself first, then every pack in it in name order
+    static void mount(const char* root) {
+        PHYSFS_mount(root, nullptr, 1);
+        std::vector<std::string> packs;
+        std::error_code ec;
+        for (const auto& item : std::filesystem::directory_iterator(root, ec)) {
+            if (item.path().extension() == EXTENSION && item.is_regular_file(ec)) {
+                packs.push_back(item.path().string());
+            }
+        }
+        std::sort(packs.begin(), packs.end());
+        for (const std::string& pack : packs) {
+            if (PHYSFS_mount(pack.c_str(), nullptr, 1)) {
+                log_console("Mounted " + pack);
+            } else {
+                log_console("Failed to mount " + pack + ": " + PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+            }
+        }
+    }
+    
+    // Files under the given directories, skipping hidden entries, temporaries and
+    // other packs and recordings
+    static std::vector<std::string> collect(const std::vector<const char*>& dirs) {
+        std::vector<std::string> files;
+        std::error_code ec;
+        for (const char* dir : dirs) {
+            auto it = std::filesystem::recursive_directory_iterator(dir, ec);
+            for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+                std::string name = it->path().filename().string();
+                if (name.size() > 1 && name[0] == '.') {
+                    it.disable_recursion_pending();
+                    continue;
+                }
+                std::string ext = it->path().extension().string();
+                if (!it->is_regular_file(ec) || ext == ".tmp" || ext == EXTENSION || ext == ".3krec") continue;
+                files.push_back(it->path().lexically_normal().generic_string());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        files.erase(std::unique(files.begin(), files.end()), files.end());
+        return files;
+    }
+    
+    // Text scenes and prefabs start with an entity command after any comments
+    static bool is_text_scene(std::string_view content) {
+        size_t i = 0;
+        while (i < content.size()) {
+            size_t end = std::min(content.find('\n', i), content.size());
+            std::string_view line = content.substr(i, end - i);
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start != std::string_view::npos && line[start] != '#') {
+                return line.substr(start).starts_with("entity");
+            }
+            i = end + 1;
+        }
+        return false;
+    }
+    
+    static uint32_t crc32(const char* data, size_t size) {
+        static const auto table = [] {
+            std::array<uint32_t, 256> t;
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                t[i] = c;
+            }
+            return t;
+        }();
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; ++i) crc = table[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+        return crc ^ 0xFFFFFFFFu;
+    }
+    
+    static void put16(std::string& out, uint16_t v) { out.append((const char*)&v, 2); }
+    static void put32(std::string& out, uint32_t v) { out.append((const char*)&v, 4); }
+    
+    static bool build(const char* out_path, const std::vector<const char*>& dirs, Stats& stats) {
+        std::time_t now = std::time(nullptr);
+        std::tm* t = std::localtime(&now);
+        uint16_t dos_time = (uint16_t)((t->tm_hour << 11) | (t->tm_min << 5) | (t->tm_sec / 2));
+        uint16_t dos_date = (uint16_t)(((t->tm_year - 80) << 9) | ((t->tm_mon + 1) << 5) | t->tm_mday);
+        
+        std::string archive;
+        std::vector<Entry> entries;
+        auto add = [&](const std::string& path, const std::string& data) {
+            Entry entry{path, crc32(data.data(), data.size()), (uint32_t)data.size(), (uint32_t)archive.size()};
+            put32(archive, 0x04034b50);
+            put16(archive, 10);     // Version needed: stored
+            put16(archive, 0x0800); // UTF-8 names
+            put16(archive, 0);      // Stored, no compression
+            put16(archive, dos_time);
+            put16(archive, dos_date);
+            put32(archive, entry.crc);
+            put32(archive, entry.size);
+            put32(archive, entry.size);
+            put16(archive, (uint16_t)path.size());
+            put16(archive, 0);
+            archive += path;
+            archive += data;
+            entries.push_back(std::move(entry));
+        };
+        
+        lua_State* L = luaL_newstate();
+        bool ok = true;
+        for (const std::string& path : collect(dirs)) {
+            std::string content;
+            if (!SceneSerializer::read_file(path.c_str(), content)) {
+                fprintf(stderr, "failed to read %s\n", path.c_str());
+                ok = false;
+                break;
+            }
+            std::string ext = std::filesystem::path(path).extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)tolower(c); });
+            
+            if (ext == ".lua") {
+                // Same chunk name and cache path as ScriptSystem::get_chunk
+                std::string chunkname = "@" + path;
+                if (luaL_loadbufferx(L, content.data(), content.size(), chunkname.c_str(), "t") != LUA_OK) {
+                    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+                    ok = false;
+                    break;
+                }
+                std::string bytecode;
+                lua_dump(L, ScriptSystem::write_chunk, &bytecode, 0);
+                lua_pop(L, 1);
+                add(ScriptSystem::bytecode_cache_path(path, content.data(), content.size()), bytecode);
+                stats.scripts++;
+            } else if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" || ext == ".tga") {
+                std::string pixels;
+                if (AssetManager::encode_texture((const uint8_t*)content.data(), content.size(), pixels)) {
+                    content = std::move(pixels);
+                    stats.textures++;
+                }
+            } else if ((ext == ".txt" || ext == ".prefab") && is_text_scene(content)) {
+                Registry scene;
+                if (!SceneSerializer::load_from_memory(content, scene, b2_nullWorldId)) {
+                    fprintf(stderr, "failed to convert scene %s\n", path.c_str());
+                    ok = false;
+                    break;
+                }
+                SceneSerializer::Snapshot snap;
+                SceneSerializer::snapshot(scene, snap);
+                content = SceneSerializer::encode_binary(snap);
+                stats.scenes++;
+            }
+            add(path, content);
+            stats.files++;
+            if (archive.size() > UINT32_MAX || entries.size() >= UINT16_MAX) {
+                fprintf(stderr, "pack exceeds 4 GB or 65535 entries\n");
+                ok = false;
+                break;
+            }
+        }
+        lua_close(L);
+        if (!ok) return false;
+        
+        // Table of contents
+        uint32_t directory_offset = (uint32_t)archive.size();
+        for (const Entry& entry : entries) {
+            put32(archive, 0x02014b50);
+            put16(archive, 20); // Made by
+            put16(archive, 10);
+            put16(archive, 0x0800);
+            put16(archive, 0);
+            put16(archive, dos_time);
+            put16(archive, dos_date);
+            put32(archive, entry.crc);
+            put32(archive, entry.size);
+            put32(archive, entry.size);
+            put16(archive, (uint16_t)entry.path.size());
+            put16(archive, 0); // Extra
+            put16(archive, 0); // Comment
+            put16(archive, 0); // Disk
+            put16(archive, 0); // Internal attributes
+            put32(archive, 0); // External attributes
+            put32(archive, entry.offset);
+            archive += entry.path;
+        }
+        uint32_t directory_size = (uint32_t)archive.size() - directory_offset;
+        put32(archive, 0x06054b50);
+        put16(archive, 0);
+        put16(archive, 0);
+        put16(archive, (uint16_t)entries.size());
+        put16(archive, (uint16_t)entries.size());
+        put32(archive, directory_size);
+        put32(archive, directory_offset);
+        put16(archive, 0);
+        if (archive.size() > UINT32_MAX) {
+            fprintf(stderr, "pack exceeds 4 GB\n");
+            return false;
+        }
+        return SceneSerializer::write_file(out_path, archive);
+    }
+};
+
+static int viewport_sprite_draws = 0; // Draw commands for the viewport's sprites last frame
+static bool show_test_window = false;
+static bool show_another_window = false;
+static bool show_viewport = true;
+static bool show_hierarchy = true;
+static bool show_inspector = true;
+static bool show_console = true;
+static bool show_assets = true;
+static bool show_profiler = false;
+static bool first_frame = true;
+static bool headless = false; // No window; replay and benchmark runs
+static bool headless_quiet = false;
+static int script_shards_override = -1; // --shards N
+
+static const float FIXED_STEP = 1.0f / 60.0f;
+
+// Console log buffer
+static std::vector<std::string> console_logs;
+static void log_console(const std::string& msg) {
+    if (headless && !headless_quiet) {
+        printf("%s\n", msg.c_str());
+    }
+    console_logs.push_back(msg);
+    if (console_logs.size() > 1000) {
+        console_logs.erase(console_logs.begin());
+    }
+}
+
+struct Vertex {
+    HMM_Vec4 pos;
+    HMM_Vec4 color;
+};
+
+// application state
+static struct {
+    sg_pass_action pass_action;
+    sgimgui_t sgimgui;
+    b2WorldId world;
+    float accumulator;
+    sol::state* lua;
+    Registry registry;
+    EntityId selected_entity;
+    bool play_mode; // Editor vs Play mode
+    std::string current_scene_path;
+    ProjectSettings settings;
+} state;
+
+static b2WorldId create_world() {
+    b2WorldDef wdef = b2DefaultWorldDef();
+    wdef.gravity = B2_LITERAL(b2Vec2){0.0f, -800.0f};
+    return b2CreateWorld(&wdef);
+}
+
+// Creates a Lua state with the engine API bound
+static sol::state* create_lua_state() {
+    sol::state* lua = new sol::state();
+    lua->open_libraries(sol::lib::base, sol::lib::math);
+    
+    // Bind input to Lua
+    lua->set_function("get_key", &InputSystem::get_key);
+    lua->set_function("get_key_down", &InputSystem::get_key_down);
+    lua->set_function("get_mouse_pos", &InputSystem::get_mouse_position);
+    lua->set_function("get_mouse_button", &InputSystem::get_mouse_button);
+    
+    // Bind component access to Lua
+    lua->set_function("get_transform", [](uint32_t entity_id, uint32_t generation) -> sol::optional<sol::table> {
+        EntityId e = {entity_id, generation};
+        Transform* t = state.registry.transforms.get(e);
+        if (!t) return sol::nullopt;
+        
+        sol::table result = state.lua->create_table();
+        result["x"] = t->position.X;
+        result["y"] = t->position.Y;
+        result["rotation"] = t->rotation;
+        return result;
+    });
+    
+    // Allocation-free accessors: values come back as multiple returns instead of a table
+    lua->set_function("get_position", [](uint32_t entity_id, uint32_t generation) -> sol::optional<std::tuple<float, float, float>> {
+        EntityId e = {entity_id, generation};
+        Transform* t = state.registry.transforms.get(e);
+        if (!t) return sol::nullopt;
+        return std::make_tuple(t->position.X, t->position.Y, t->rotation);
+    });
+    
+    lua->set_function("set_transform", [](uint32_t entity_id, uint32_t generation, float x, float y) {
+        EntityId e = {entity_id, generation};
+        Transform* t = state.registry.transforms.get(e);
+        if (t) {
+            t->position.X = x;
+            t->position.Y = y;
+        }
+    });
+
+    lua->set_function("get_velocity", [](uint32_t entity_id, uint32_t generation) -> sol::optional<sol::table> {
+        EntityId e = {entity_id, generation};
+        Rigidbody* rb = state.registry.rigidbodies.get(e);
+        if (!rb || !b2Body_IsValid(rb->body)) return sol::nullopt;
+        
+        b2Vec2 vel = b2Body_GetLinearVelocity(rb->body);
+        sol::table result = state.lua->create_table();
+        result["x"] = vel.x;
+        result["y"] = vel.y;
+        return result;
+    });
+    
+    lua->set_function("get_linear_velocity", [](uint32_t entity_id, uint32_t generation) -> sol::optional<std::tuple<float, float>> {
+        EntityId e = {entity_id, generation};
+        Rigidbody* rb = state.registry.rigidbodies.get(e);
+        if (!rb || !b2Body_IsValid(rb->body)) return sol::nullopt;
+        
+        b2Vec2 vel = b2Body_GetLinearVelocity(rb->body);
+        return std::make_tuple(vel.x, vel.y);
+    });
+    
+    lua->set_function("set_velocity", [](uint32_t entity_id, uint32_t generation, float vx, float vy) {
+        EntityId e = {entity_id, generation};
+        Rigidbody* rb = state.registry.rigidbodies.get(e);
+        if (rb && b2Body_IsValid(rb->body)) {
+            b2Body_SetLinearVelocity(rb->body, b2Vec2{vx, vy});
+        }
+    });
+    
+    lua->set_function("apply_impulse", [](uint32_t entity_id, uint32_t generation, float ix, float iy) {
+        EntityId e = {entity_id, generation};
+        Rigidbody* rb = state.registry.rigidbodies.get(e);
+        if (rb && b2Body_IsValid(rb->body)) {
+            b2Body_ApplyLinearImpulseToCenter(rb->body, b2Vec2{ix, iy}, true);
+        }
+    });
+    
+    lua->set_function("spawn", [](const std::string& prefab, float x, float y) -> sol::optional<std::tuple<uint32_t, uint32_t>> {
+        EntityId e = PrefabSystem::spawn(state.registry, prefab, x, y);
+        if (e == NULL_ENTITY) return sol::nullopt;
+        return std::make_tuple(e.id, e.generation);
+    });
+    
+    lua->set_function("despawn", [](uint32_t entity_id, uint32_t generation) {
+        PrefabSystem::despawn({entity_id, generation});
+    });
+    
+    lua->set_function("destroy_entity", [](uint32_t entity_id, uint32_t generation) {
+        EntityId e = {entity_id, generation};
+        if (state.registry.valid(e)) {
+            PhysicsSystem::destroy_entity(state.registry, e);
+            log_console("Entity " + std::to_string(entity_id) + " destroyed by script");
+        }
+    });
+    
+    // Bind utility functions
+    lua->set_function("log", [](const std::string& msg) {
+        log_console("[Lua] " + msg);
+    });
+    
+    // Global game state for scripts
+    lua->set("game_over", false);
+    lua->set("game_score", 0);
+    
+    bind_entity_lookup(*lua, [] { return &state.registry; });
+    ScriptScheduler::bind(lua);
+    EventBus::bind(*lua, [](uint32_t id, const double* args, uint32_t argc) {
+        EventBus::emit(id, args, argc);
+    });
+    ScriptGC::configure(lua->lua_state(), state.settings);
+    ScriptWatchdog::budget_ms = state.settings.script_budget_ms;
+    ScriptWatchdog::instruction_budget = state.settings.script_instruction_budget;
+    install_script_hook(lua->lua_state());
+    ScriptShards::create(state.settings.script_shards);
+    
+    return lua;
+}
+
+// Hash of every transform, used to check that a replay reproduced a session bit-exactly
+static uint64_t scene_checksum(Registry& reg) {
+    uint64_t h = hash_bytes(nullptr, 0);
+    reg.transforms.each([&](EntityId e, Transform& t) {
+        h = hash_bytes(&e.id, sizeof(e.id), h);
+        h = hash_bytes(&t.position, sizeof(t.position), h);
+        h = hash_bytes(&t.rotation, sizeof(t.rotation), h);
+    });
+    return h;
+}
+
+// Destroys every entity in the scene
+static void clear_scene() {
+    SceneStreamer::cancel(state.registry);
+    WorldPartition::unload_all(state.registry);
+    EditorHistory::clear();
+    ScriptScheduler::clear();
+    EventBus::clear();
+    PrefabSystem::clear(state.registry);
+    ScriptSystem::reset_ticks();
+    std::vector<EntityId> to_delete;
+    state.registry.transforms.each([&](EntityId e, Transform& t) {
+        to_delete.push_back(e);
+    });
+    for (auto e : to_delete) {
+        PhysicsSystem::destroy_entity(state.registry, e);
+    }
+    state.selected_entity = NULL_ENTITY;
+}
+
+// Rebuilds registry, physics world and Lua state from a scene snapshot, so a
+// recorded session and its replay start from identical state
+static void reset_session(const std::string& scene, uint32_t seed) {
+    ScriptScheduler::clear();
+    EventBus::clear();
+    PrefabSystem::clear(state.registry);
+    state.registry = Registry(); // releases script references while their Lua state is alive
+    state.selected_entity = NULL_ENTITY;
+    b2DestroyWorld(state.world);
+    state.world = create_world();
+    ScriptShards::shutdown();
+    delete state.lua;
+    state.lua = create_lua_state();
+    (*state.lua)["math"]["randomseed"](seed);
+    ScriptShards::seed(seed);
+    SceneSerializer::load_from_memory(scene, state.registry, state.world);
+    state.accumulator = 0.0f;
+}
+
+// Engine events: "collision_begin" and "collision_end" carry the two entities
+// as (id_a, generation_a, id_b, generation_b)
+static void emit_contact_events(b2WorldId world) {
+    static const uint32_t begin_id = EventNames::intern("collision_begin");
+    static const uint32_t end_id = EventNames::intern("collision_end");
+    bool begin = EventBus::has_listeners(begin_id);
+    bool end = EventBus::has_listeners(end_id);
+    if (!begin && !end) return;
+    
+    b2ContactEvents contacts = b2World_GetContactEvents(world);
+    auto emit = [](uint32_t id, b2ShapeId a, b2ShapeId b) {
+        if (!b2Shape_IsValid(a) || !b2Shape_IsValid(b)) return;
+        EntityId ea = PhysicsSystem::body_entity(b2Shape_GetBody(a));
+        EntityId eb = PhysicsSystem::body_entity(b2Shape_GetBody(b));
+        double args[4] = { (double)ea.id, (double)ea.generation, (double)eb.id, (double)eb.generation };
+        EventBus::emit(id, args, 4);
+    };
+    for (int i = 0; begin && i < contacts.beginCount; ++i) {
+        emit(begin_id, contacts.beginEvents[i].shapeIdA, contacts.beginEvents[i].shapeIdB);
+    }
+    for (int i = 0; end && i < contacts.endCount; ++i) {
+        emit(end_id, contacts.endEvents[i].shapeIdA, contacts.endEvents[i].shapeIdB);
+    }
+}
+
+// One fixed simulation step, shared by play mode and headless replay
+static void fixed_update(float step) {
+    // Update scripts, deliver their events, then resume coroutines that are due
+    ScriptSystem::update_scripts(state.registry, state.lua, step);
+    EventBus::dispatch(state.registry, [](Script& sc) { return ScriptShards::Scope(sc.shard, sc.entity); });
+    ScriptShards::apply(state.registry);
+    ScriptScheduler::run(state.registry, step);
+    PrefabSystem::flush(state.registry, state.world, state.lua);
+    
+    // Sync editor changes to physics
+    PhysicsSystem::sync_to_physics(state.registry, state.world);
+    
+    b2World_Step(state.world, step, 4);
+    emit_contact_events(state.world);
+    
+    // Sync physics back to transforms
+    PhysicsSystem::sync_from_physics(state.registry, state.world);
+}
+
+// Saves the editor scene for Stop to restore. World cells are dropped first and stream
+// back in from disk around the camera.
+static void save_editor_state() {
+    SceneStreamer::finish(state.registry, state.world);
+    WorldPartition::unload_all(state.registry);
+    SceneSaver::save("_temp_editor_state.3kscene", state.registry, false);
+}
+
+static void start_recording() {
+    save_editor_state();
+    std::ostringstream scene;
+    SceneSerializer::write(scene, state.registry);
+    
+    uint32_t seed = (uint32_t)std::time(nullptr);
+    reset_session(scene.str(), seed);
+    InputRecorder::begin(scene.str(), seed, FIXED_STEP, state.settings.script_shards);
+    state.play_mode = true;
+    log_console("Entering Play mode (recording input)");
+    if (!WorldPartition::root.empty()) {
+        log_console("World cells stream outside the fixed step; this recording will not replay deterministically");
+    }
+}
+
+static void finish_recording() {
+    if (!InputRecorder::recording) return;
+    
+    char path[64];
+    std::time_t now = std::time(nullptr);
+    std::strftime(path, sizeof(path), "session_%Y%m%d_%H%M%S.3krec", std::localtime(&now));
+    uint32_t steps = InputRecorder::rec.step_count;
+    if (InputRecorder::end(path, scene_checksum(state.registry))) {
+        log_console("Recording saved: " + std::string(path) + " (" + std::to_string(steps) + " steps)");
+    } else {
+        log_console("Failed to save recording: " + std::string(path));
+    }
+}
+
+// Leaves play mode and brings back the scene save_editor_state() stored
+static void restore_editor_state() {
+    state.play_mode = false;
+    finish_recording();
+    clear_scene();
+    SceneSaver::wait();
+    SceneSerializer::load("_temp_editor_state.3kscene", state.registry, state.world);
+}
+
+static void headless_init() {
+    PHYSFS_init(nullptr);
+    AssetPack::mount(".");
+    state.settings.load("project.txt");
+    if (script_shards_override >= 0) state.settings.script_shards = script_shards_override;
+    state.world = create_world();
+    state.lua = create_lua_state();
+    state.selected_entity = NULL_ENTITY;
+}
+
+static void headless_shutdown() {
+    ScriptScheduler::clear();
+    EventBus::clear();
+    PrefabSystem::clear(state.registry);
+    state.registry = Registry();
+    b2DestroyWorld(state.world);
+    ScriptShards::shutdown();
+    delete state.lua;
+    state.lua = nullptr;
+    PHYSFS_deinit();
+}
+
+static void print_gc_stats() {
+    printf("  lua gc: %s, %s, %u KB, %u cycles, %u slices, avg %.4f ms, max %.4f ms, %u forced\n",
+           ScriptGC::generational ? "generational" : "incremental",
+           ScriptGC::manual ? "frame budget" : "automatic",
+           (unsigned)ScriptGC::memory_kb(state.lua->lua_state()), ScriptGC::cycles, ScriptGC::slices,
+           ScriptGC::slices ? ScriptGC::total_ms / ScriptGC::slices : 0.0, ScriptGC::max_slice_ms, ScriptGC::forced);
+}
+
+static void print_prefab_stats() {
+    for (const auto& prefab : PrefabSystem::prefabs) {
+        printf("  prefab %s: %u built, %u reused, %zu parked\n", prefab.path.c_str(), prefab.built, prefab.reused, prefab.pool.size());
+    }
+}
+
+static void print_script_profile() {
+    printf("%-32s %10s %12s %10s %10s\n", "script", "calls", "total ms", "avg us", "max us");
+    for (const auto& stats : ScriptProfiler::paths) {
+        if (stats.calls == 0) continue;
+        printf("%-32s %10llu %12.3f %10.2f %10.2f\n", stats.path.c_str(), (unsigned long long)stats.calls,
+               stats.total_ms, stats.total_ms * 1000.0 / stats.calls, stats.max_ms * 1000.0);
+    }
+}
+
+// Headless replay: feeds a recording back through the fixed step without a window
+// and reports step timings, so a captured session can serve as a benchmark
+static int run_replay(const char* path, int repeat) {
+    headless = true;
+    InputRecording rec;
+    if (!rec.load(path)) {
+        fprintf(stderr, "Failed to load recording: %s\n", path);
+        return 1;
+    }
+    
+    // Parallel scripts see their shard's state, so a different shard count can diverge
+    if (rec.script_shards >= 0) {
+        if (script_shards_override >= 0 && script_shards_override != rec.script_shards) {
+            printf("recorded with %d script shards, ignoring --shards %d\n", rec.script_shards, script_shards_override);
+        }
+        script_shards_override = rec.script_shards;
+    }
+    headless_init();
+    
+    bool all_match = true;
+    for (int run = 0; run < repeat; ++run) {
+        reset_session(rec.scene, rec.seed);
+        InputReplayer replayer;
+        replayer.rec = &rec;
+        
+        double total_ms = 0.0, min_ms = 1e9, max_ms = 0.0;
+        for (uint32_t i = 0; i < rec.step_count; ++i) {
+            replayer.apply_step(i);
+            auto t0 = std::chrono::steady_clock::now();
+            fixed_update(rec.step);
+            ScriptGC::step(state.lua->lua_state()); // one step per frame, as in the editor
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            total_ms += ms;
+            min_ms = std::min(min_ms, ms);
+            max_ms = std::max(max_ms, ms);
+        }
+        
+        uint64_t checksum = scene_checksum(state.registry);
+        bool match = checksum == rec.final_checksum;
+        all_match = all_match && match;
+        printf("run %d: %u steps, total %.3f ms, avg %.4f ms, min %.4f ms, max %.4f ms, checksum %016llx %s\n",
+               run + 1, rec.step_count, total_ms, rec.step_count ? total_ms / rec.step_count : 0.0,
+               rec.step_count ? min_ms : 0.0, max_ms, (unsigned long long)checksum, match ? "(match)" : "(MISMATCH)");
+        print_gc_stats();
+        print_prefab_stats();
+    }
+    
+    if (ScriptProfiler::enabled) {
+        print_script_profile();
+        if (ScriptProfiler::dump_folded("script_profile.folded")) {
+            printf("wrote script_profile.folded (%zu stacks)\n", ScriptProfiler::stacks.size());
+        }
+    }
+    
+    headless_shutdown();
+    return all_match ? 0 : 2;
+}
+
+// Headless script benchmark: N entities running a trivial update, comparing the
+// cached protected-call dispatch against per-tick table lookups
+static int run_script_bench(int count, int steps) {
+    headless = true;
+    headless_init();
+    
+    const char* bench_path = "_bench_script.lua";
+    {
+        std::ofstream file(bench_path);
+        file << "local n = 0\n"
+                "return {\n"
+                "    update = function(dt)\n"
+                "        if bench_mode == 1 then\n"
+                "            local p = get_transform(entity_id, entity_generation)\n"
+                "            set_transform(entity_id, entity_generation, p.x + dt, p.y)\n"
+                "        elseif bench_mode == 2 then\n"
+                "            local x, y = get_position(entity_id, entity_generation)\n"
+                "            set_transform(entity_id, entity_generation, x + dt, y)\n"
+                "        else\n"
+                "            n = n + 1\n"
+                "        end\n"
+                "    end\n"
+                "}\n";
+    }
+    
+    for (int i = 0; i < count; ++i) {
+        EntityId e = state.registry.create();
+        state.registry.transforms.add(e, Transform());
+        Script sc;
+        sc.path = bench_path;
+        state.registry.scripts.add(e, sc);
+    }
+    
+    // First tick loads every script
+    auto t0 = std::chrono::steady_clock::now();
+    ScriptSystem::update_scripts(state.registry, state.lua, FIXED_STEP);
+    double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; ++i) {
+        ScriptSystem::update_scripts(state.registry, state.lua, FIXED_STEP);
+    }
+    double cached_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    
+    // Per-tick environment write and table lookup, as update_scripts used to do
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; ++i) {
+        state.registry.scripts.each([&](EntityId e, Script& sc) {
+            sc.env["entity_generation"] = e.generation;
+            sol::optional<sol::function> update_fn = sc.instance["update"];
+            if (update_fn) {
+                (*update_fn)(FIXED_STEP);
+            }
+        });
+    }
+    double lookup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    
+    double calls = (double)count * steps;
+    printf("scripts: %d entities, %d steps\n", count, steps);
+    printf("  load:            %.3f ms (%.2f us/script)\n", load_ms, load_ms * 1000.0 / count);
+    printf("  cached call:     %.3f ms (%.1f ns/call)\n", cached_ms, cached_ms * 1e6 / calls);
+    printf("  per-tick lookup: %.3f ms (%.1f ns/call)\n", lookup_ms, lookup_ms * 1e6 / calls);
+    
+    // Component access: table-returning get_transform vs multiple-return get_position.
+    // Allocation is measured with the collector stopped, time with it running.
+    lua_State* L = state.lua->lua_state();
+    const char* access_names[] = { "get_transform (table)", "get_position (multret)" };
+    for (int mode = 1; mode <= 2; ++mode) {
+        (*state.lua)["bench_mode"] = mode;
+        lua_gc(L, LUA_GCCOLLECT);
+        
+        lua_gc(L, LUA_GCSTOP);
+        int alloc_steps = std::min(steps, 10);
+        size_t before = (size_t)lua_gc(L, LUA_GCCOUNT) * 1024 + lua_gc(L, LUA_GCCOUNTB);
+        for (int i = 0; i < alloc_steps; ++i) {
+            ScriptSystem::update_scripts(state.registry, state.lua, FIXED_STEP);
+        }
+        size_t after = (size_t)lua_gc(L, LUA_GCCOUNT) * 1024 + lua_gc(L, LUA_GCCOUNTB);
+        lua_gc(L, LUA_GCRESTART);
+        lua_gc(L, LUA_GCCOLLECT);
+        
+        t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < steps; ++i) {
+            ScriptSystem::update_scripts(state.registry, state.lua, FIXED_STEP);
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        
+        printf("  %-24s %.3f ms (%.1f ns/call), %.1f bytes allocated/call, %.1f KB/step\n",
+               access_names[mode - 1], ms, ms * 1e6 / calls,
+               (double)(after - before) / ((double)count * alloc_steps),
+               (double)(after - before) / 1024.0 / alloc_steps);
+    }
+    
+    // Coroutine scripts sleeping in wait(): the scheduler should not touch them per step
+    clear_scene();
+    const char* wait_path = "_bench_wait.lua";
+    {
+        std::ofstream file(wait_path);
+        file << "return {\n"
+                "    run = function()\n"
+                "        while true do\n"
+                "            wait(3)\n"
+                "        end\n"
+                "    end\n"
+                "}\n";
+    }
+    for (int i = 0; i < count; ++i) {
+        EntityId e = state.registry.create();
+        state.registry.transforms.add(e, Transform());
+        Script sc;
+        sc.path = wait_path;
+        state.registry.scripts.add(e, sc);
+    }
+    ScriptSystem::update_scripts(state.registry, state.lua, FIXED_STEP);
+    ScriptScheduler::run(state.registry, FIXED_STEP);
+    
+    int idle_steps = std::min(steps, 150); // shorter than the 3 second wait
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < idle_steps; ++i) {
+        ScriptScheduler::run(state.registry, FIXED_STEP);
+    }
+    double idle_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    printf("  sleeping coroutines:    %.3f ms for %d steps (%.4f ms/step)\n", idle_ms, idle_steps, idle_ms / idle_steps);
+    
+    // Tick-rate tiers: per-step cost of every script at interval 1 vs interval 4,
+    // where the phases should keep the steps equally loaded
+    for (int interval : {1, 4}) {
+        clear_scene();
+        std::string tier_path = "_bench_tier" + std::to_string(interval) + ".lua";
+        {
+            std::ofstream file(tier_path);
+            file << "local n = 0\n"
+                    "return {\n"
+                    "    update_interval = " << interval << ",\n"
+                    "    update = function(dt)\n"
+                    "        for i = 1, 20 do n = n + i * dt end\n"
+                    "    end\n"
+                    "}\n";
+        }
+        for (int i = 0; i < count; ++i) {
+            EntityId e = state.registry.create();
+            state.registry.transforms.add(e, Transform());
+            Script sc;
+            sc.path = tier_path;
+            state.registry.scripts.add(e, sc);
+        }
+        ScriptSystem::update_scripts(state.registry, state.lua, FIXED_STEP);
+        
+        double total_ms = 0.0, min_ms = 1e9, max_ms = 0.0;
+        for (int i = 0; i < steps; ++i) {
+            t0 = std::chrono::steady_clock::now();
+            ScriptSystem::update_scripts(state.registry, state.lua, FIXED_STEP);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            total_ms += ms;
+            min_ms = std::min(min_ms, ms);
+            max_ms = std::max(max_ms, ms);
+        }
+        printf("  update_interval %d:      avg %.4f ms/step, min %.4f, max %.4f\n", interval, total_ms / steps, min_ms, max_ms);
+        std::remove(tier_path.c_str());
+    }
+    
+    // Prefab churn: spawn and despawn a batch per round, with and without pools
+    {
+        clear_scene();
+        const char* prefab_path = "_bench_bullet.prefab";
+        const char* bullet_path = "_bench_bullet.lua";
+        std::ofstream(prefab_path) << "entity 0 0\n  transform 0 0 0 1 1\n  sprite 1 1 1 1 8 8\n"
+                                      "  rigidbody 2 0 1 0.3 0\n  script " << bullet_path << "\n";
+        std::ofstream(bullet_path) << "local age = 0\n"
+                                      "return {\n"
+                                      "    on_spawn = function() age = 0 end,\n"
+                                      "    update = function(dt) age = age + dt end\n"
+                                      "}\n";
+        int batch = std::min(count, 500);
+        int rounds = std::max(1, std::min(steps, 50));
+        for (size_t pool : {(size_t)0, (size_t)batch}) {
+            PrefabSystem::clear(state.registry);
+            PrefabSystem::max_pool = pool;
+            std::vector<EntityId> live;
+            t0 = std::chrono::steady_clock::now();
+            for (int r = 0; r < rounds; ++r) {
+                for (int i = 0; i < batch; ++i) {
+                    live.push_back(PrefabSystem::spawn(state.registry, prefab_path, (float)i, 0.0f));
+                }
+                PrefabSystem::flush(state.registry, state.world, state.lua);
+                ScriptSystem::update_scripts(state.registry, state.lua, FIXED_STEP);
+                for (EntityId e : live) PrefabSystem::despawn(e);
+                live.clear();
+                PrefabSystem::flush(state.registry, state.world, state.lua);
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            printf("  spawn churn, pool %-4zu %.3f ms (%.2f us per spawn+despawn)\n", pool, ms, ms * 1000.0 / ((double)batch * rounds));
+        }
+        PrefabSystem::max_pool = 256;
+        std::remove(prefab_path);
+        std::remove(bullet_path);
+    }
+    
+    // Sharded VMs: the same own-entity script on the main state and as --!parallel
+    if (ScriptShards::count() > 0) {
+        const char* parallel_names[] = { "_bench_serial.lua", "_bench_parallel.lua" };
+        for (int parallel = 0; parallel <= 1; ++parallel) {
+            clear_scene();
+            {
+                std::ofstream file(parallel_names[parallel]);
+                file << (parallel ? "--!parallel\n" : "") <<
+                        "return {\n"
+                        "    update = function(dt)\n"
+                        "        local x, y = get_position(entity_id, entity_generation)\n"
+                        "        for i = 1, 100 do x = x + math.sin(i * dt) * dt end\n"
+                        "        set_transform(entity_id, entity_generation, x, y)\n"
+                        "    end\n"
+                        "}\n";
+            }
+            for (int i = 0; i < count; ++i) {
+                EntityId e = state.registry.create();
+                state.registry.transforms.add(e, Transform());
+                Script sc;
+                sc.path = parallel_names[parallel];
+                state.registry.scripts.add(e, sc);
+            }
+            ScriptSystem::update_scripts(state.registry, state.lua, FIXED_STEP);
+            
+            t0 = std::chrono::steady_clock::now();
+            for (int i = 0; i < steps; ++i) {
+                ScriptSystem::update_scripts(state.registry, state.lua, FIXED_STEP);
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            printf("  %-24s %.3f ms (%.4f ms/step)\n", parallel ? "parallel shards" : "main state", ms, ms / steps);
+            std::remove(parallel_names[parallel]);
+        }
+        printf("  (%d shards)\n", ScriptShards::count());
+    }
+    
+    headless_shutdown();
+    std::remove(bench_path);
+    std::remove(wait_path);
+    return 0;
+}
+
+// Converts between the text and binary scene formats; the output extension decides
+static int run_scene_convert(const char* in_path, const char* out_path) {
+    headless = true;
+    PHYSFS_init(nullptr);
+    PHYSFS_mount(".", nullptr, 1);
+    Registry reg;
+    bool ok = SceneSerializer::load(in_path, reg, b2_nullWorldId);
+    if (ok) ok = SceneSerializer::save(out_path, reg);
+    if (ok) {
+        printf("converted %s -> %s (%zu entities)\n", in_path, out_path, reg.transforms.entities.size());
+    } else {
+        fprintf(stderr, "failed to convert %s -> %s\n", in_path, out_path);
+    }
+    PHYSFS_deinit();
+    return ok ? 0 : 1;
+}
+
+// Bundles directories into a pack, see AssetPack
+static int run_pack(const char* out_path, const std::vector<const char*>& dirs) {
+    headless = true;
+    PHYSFS_init(nullptr);
+    PHYSFS_mount(".", nullptr, 1);
+    AssetPack::Stats stats;
+    bool ok = AssetPack::build(out_path, dirs, stats);
+    if (ok) {
+        printf("packed %zu files into %s (%zu scenes, %zu scripts, %zu textures)\n", stats.files, out_path,
+               stats.scenes, stats.scripts, stats.textures);
+    } else {
+        fprintf(stderr, "failed to pack %s\n", out_path);
+    }
+    PHYSFS_deinit();
+    return ok ? 0 : 1;
+}
+
+// Splits a scene into a world directory of cells, see WorldPartition
+static int run_world_partition(const char* in_path, const char* out_dir, float cell_size) {
+    headless = true;
+    PHYSFS_init(nullptr);
+    PHYSFS_mount(".", nullptr, 1);
+    Registry scene;
+    size_t cell_count = 0;
+    bool ok = cell_size > 0.0f && SceneSerializer::load(in_path, scene, b2_nullWorldId) &&
+              WorldPartition::partition(scene, out_dir, cell_size, cell_count);
+    if (ok) {
+        printf("partitioned %s -> %s (%zu entities, %zu cells of %g)\n", in_path, out_dir,
+               scene.transforms.entities.size(), cell_count, cell_size);
+    } else {
+        fprintf(stderr, "failed to partition %s -> %s\n", in_path, out_dir);
+    }
+    PHYSFS_deinit();
+    return ok ? 0 : 1;
+}
+
+// Physics step cost and resident entities for a generated level, fully loaded vs
+// streamed as a world while a camera sweeps across it
+static int run_world_bench(int count, int steps) {
+    headless = true;
+    headless_init();
+    
+    // Square grid of static blocks 64 apart; every 16th is a dynamic box resting on one
+    int side = std::max(1, (int)std::sqrt((double)count));
+    float extent = side * 64.0f;
+    Registry level;
+    for (int i = 0; i < side * side; ++i) {
+        EntityId e = level.create();
+        Transform t;
+        t.position = {(float)(i % side) * 64.0f, (float)(i / side) * 64.0f};
+        level.transforms.add(e, t);
+        Sprite sprite;
+        sprite.size = {60.0f, 20.0f};
+        level.sprites.add(e, sprite);
+        Rigidbody rb;
+        rb.body_type = i % 16 == 0 ? b2_dynamicBody : b2_staticBody;
+        level.rigidbodies.add(e, rb);
+    }
+    const char* dir = "_bench_world";
+    size_t cell_count = 0;
+    SceneSerializer::save("_bench_world.3kscene", level);
+    WorldPartition::partition(level, dir, 1024.0f, cell_count);
+    level = Registry();
+    
+    auto ms_since = [](std::chrono::steady_clock::time_point t0) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    };
+    auto camera_at = [&](int step) {
+        float f = (float)step / (float)steps;
+        return HMM_Vec2{f * extent, f * extent};
+    };
+    
+    printf("world: %d entities, %zu cells, %d steps\n", side * side, cell_count, steps);
+    
+    // Everything resident
+    SceneSerializer::load("_bench_world.3kscene", state.registry, state.world);
+    size_t full_entities = state.registry.transforms.entities.size();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; ++i) {
+        b2World_Step(state.world, FIXED_STEP, 4);
+    }
+    double full_ms = ms_since(t0);
+    printf("  full:     %8zu resident, %.3f ms/step\n", full_entities, full_ms / steps);
+    
+    // Streamed around a moving camera
+    clear_scene();
+    b2DestroyWorld(state.world);
+    state.world = create_world();
+    EntityId camera = state.registry.create();
+    state.registry.transforms.add(camera, Transform());
+    state.registry.cameras.add(camera, Camera());
+    WorldPartition::open(dir, state.registry, state.world);
+    size_t max_resident = 0;
+    double stream_ms = 0.0, max_stream_ms = 0.0, step_ms = 0.0;
+    for (int i = 0; i < steps; ++i) {
+        state.registry.transforms.get(camera)->position = camera_at(i);
+        t0 = std::chrono::steady_clock::now();
+        WorldPartition::update(state.registry, state.world, camera_at(i), state.settings.scene_stream_budget_ms);
+        double ms = ms_since(t0);
+        stream_ms += ms;
+        if (i > 0) max_stream_ms = std::max(max_stream_ms, ms); // The first update primes synchronously
+        
+        t0 = std::chrono::steady_clock::now();
+        b2World_Step(state.world, FIXED_STEP, 4);
+        step_ms += ms_since(t0);
+        max_resident = std::max(max_resident, state.registry.transforms.entities.size());
+    }
+    printf("  streamed: %8zu resident at most, %.3f ms/step + %.3f ms/step streaming (longest %.3f ms)\n",
+           max_resident, step_ms / steps, stream_ms / steps, max_stream_ms);
+    
+    WorldPartition::close(state.registry);
+    headless_shutdown();
+    std::filesystem::remove_all(dir);
+    std::remove("_bench_world.3kscene");
+    return 0;
+}
+
+// Texture load cost for every image in a directory: full decode, then read back from
+// the decoded texture cache
+static int run_texture_bench(const char* dir) {
+    headless = true;
+    PHYSFS_init(nullptr);
+    PHYSFS_mount(".", nullptr, 1);
+    
+    std::vector<std::string> paths;
+    std::error_code ec;
+    for (const auto& item : std::filesystem::directory_iterator(dir, ec)) {
+        std::string ext = item.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)tolower(c); });
+        if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" || ext == ".tga") {
+            paths.push_back(item.path().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    printf("%zu textures in %s\n", paths.size(), dir);
+    
+    auto ms_since = [](std::chrono::steady_clock::time_point t0) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    };
+    double pixel_mb = 0.0, file_mb = 0.0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (const std::string& path : paths) {
+        std::string file, encoded;
+        SceneSerializer::read_file(path.c_str(), file);
+        if (AssetManager::encode_texture((const uint8_t*)file.data(), file.size(), encoded)) {
+            pixel_mb += (double)encoded.size() / (1024.0 * 1024.0);
+        }
+        file_mb += (double)file.size() / (1024.0 * 1024.0);
+    }
+    double decode_ms = ms_since(t0);
+    printf("  decode %9.3f ms (%.2f MB files -> %.2f MB pixels)\n", decode_ms, file_mb, pixel_mb);
+    
+    for (const char* pass : {"first", "cached"}) {
+        size_t hits = 0;
+        t0 = std::chrono::steady_clock::now();
+        for (const std::string& path : paths) {
+            AssetManager::Image image;
+            image.path = path;
+            if (AssetManager::decode(image) && image.cached) hits++;
+        }
+        printf("  %-6s %9.3f ms (%zu/%zu from cache)\n", pass, ms_since(t0), hits, paths.size());
+    }
+    PHYSFS_deinit();
+    return 0;
+}
+
+// Save and load throughput of a generated scene in both formats, next to the cost of
+// only reading the file. Bodies are not created, so loads measure parsing and filling
+// the component arrays.
+static int run_scene_bench(int count) {
+    headless = true;
+    PHYSFS_init(nullptr);
+    PHYSFS_mount(".", nullptr, 1);
+    
+    Registry scene;
+    for (int i = 0; i < count; ++i) {
+        EntityId e = scene.create();
+        Transform t;
+        t.position = {(float)(i % 1000) * 32.0f, (float)(i / 1000) * 32.0f};
+        t.rotation = (float)(i % 360) * 0.0174533f;
+        scene.transforms.add(e, t);
+        Sprite sprite;
+        sprite.color = {(float)(i % 7) / 7.0f, 0.5f, 1.0f, 1.0f};
+        sprite.size = {32.0f, 32.0f};
+        scene.sprites.add(e, sprite);
+        if (i % 4 == 0) {
+            Rigidbody rb;
+            rb.body_type = b2_staticBody;
+            scene.rigidbodies.add(e, rb);
+        }
+        if (i % 16 == 0) {
+            Script sc;
+            sc.path = "enemy.lua";
+            scene.scripts.add(e, sc);
+            scene.set_tag(e, "enemy");
+        }
+    }
+    
+    auto ms_since = [](std::chrono::steady_clock::time_point t0) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    };
+    auto mb_per_s = [](double bytes, double ms) { return bytes / (1024.0 * 1024.0) / (ms / 1000.0); };
+    
+    printf("scene: %d entities\n", count);
+    {
+        // What an editor save costs the frame; encoding and writing happen on SceneSaver's thread
+        auto t0 = std::chrono::steady_clock::now();
+        SceneSerializer::Snapshot snap;
+        SceneSerializer::snapshot(scene, snap);
+        printf("  snapshot %9.3f ms\n", ms_since(t0));
+    }
+    for (const char* path : {"_bench_scene.txt", "_bench_scene.3kscene"}) {
+        auto t0 = std::chrono::steady_clock::now();
+        SceneSerializer::save(path, scene);
+        double save_ms = ms_since(t0);
+        
+        t0 = std::chrono::steady_clock::now();
+        PHYSFS_File* file = PHYSFS_openRead(path);
+        PHYSFS_sint64 size = PHYSFS_fileLength(file);
+        std::string content((size_t)size, '\0');
+        PHYSFS_readBytes(file, content.data(), (PHYSFS_uint64)size);
+        PHYSFS_close(file);
+        double read_ms = ms_since(t0);
         
-        sg_image_desc img_desc = {};
-        img_desc.width = width;
-        img_desc.height = height;
-        img_desc.pixel_format = SG_PIXELFORMAT_RGBA8;
-        img_desc.data.mip_levels[0].ptr = pixels;
-        img_desc.data.mip_levels[0].size = (size_t)(width * height * 4);
+        Registry reg;
+        t0 = std::chrono::steady_clock::now();
+        bool ok = SceneSerializer::load(path, reg, b2_nullWorldId);
+        double load_ms = ms_since(t0);
         
-        sg_image img = sg_make_image(&img_desc);
-        stbi_image_free(pixels);
+        printf("  %-22s %8.2f MB\n", path, (double)size / (1024.0 * 1024.0));
+        printf("    save %9.3f ms (%7.1f MB/s)\n", save_ms, mb_per_s((double)size, save_ms));
+        printf("    read %9.3f ms (%7.1f MB/s)\n", read_ms, mb_per_s((double)size, read_ms));
+        printf("    load %9.3f ms (%7.1f MB/s, %.1f ns/entity)%s\n", load_ms, mb_per_s((double)size, load_ms),
+               load_ms * 1e6 / count, ok && reg.transforms.entities.size() == (size_t)count ? "" : " FAILED");
         
-        textures[path] = img;
-        return img;
-    }
-    
-    static void cleanup() {
-        for (auto& pair : textures) {
-            sg_destroy_image(pair.second);
+        // Editor-style streaming in 4 ms slices: frames taken and the longest slice
+        Registry streamed;
+        SceneSerializer::LoadCursor cursor;
+        cursor.data = content;
+        int frames = 0;
+        double worst_ms = 0.0;
+        if (SceneSerializer::begin_load(cursor, streamed)) {
+            while (!cursor.done && !cursor.failed) {
+                t0 = std::chrono::steady_clock::now();
+                SceneSerializer::load_step(cursor, streamed, b2_nullWorldId, t0 + std::chrono::milliseconds(4));
+                worst_ms = std::max(worst_ms, ms_since(t0));
+                frames++;
+            }
         }
-        textures.clear();
-    }
-};
-
-std::unordered_map<std::string, sg_image> AssetManager::textures;
-
-static bool show_test_window = false;
-static bool show_another_window = false;
-static bool show_viewport = true;
-static bool show_hierarchy = true;
-static bool show_inspector = true;
-static bool show_console = true;
-static bool show_assets = true;
-static bool first_frame = true;
-
-// Console log buffer
-static std::vector<std::string> console_logs;
-static void log_console(const std::string& msg) {
-    console_logs.push_back(msg);
-    if (console_logs.size() > 1000) {
-        console_logs.erase(console_logs.begin());
+        printf("    stream %d frames, longest slice %.3f ms%s\n", frames, worst_ms,
+               cursor.done && streamed.transforms.entities.size() == (size_t)count ? "" : " FAILED");
+        std::remove(path);
     }
+    
+    PHYSFS_deinit();
+    return 0;
 }
 
-struct Vertex {
-    HMM_Vec4 pos;
-    HMM_Vec4 color;
-};
-
-// application state
-static struct {
-    sg_pass_action pass_action;
-    sgimgui_t sgimgui;
-    b2WorldId world;
-    float accumulator;
-    sol::state* lua;
-    Registry registry;
-    EntityId selected_entity;
-    bool play_mode; // Editor vs Play mode
-    std::string current_scene_path;
-} state;
-
 void init(void) {
     sg_desc _sg_desc{};
     _sg_desc.environment = sglue_environment();
@@ -707,91 +5351,16 @@ void init(void) {
     colors[ImGuiCol_TextSelectedBg]        = ImVec4(accent.x, accent.y, accent.z, 0.35f);
 
     // Box2D world
-    b2WorldDef wdef = b2DefaultWorldDef();
-    wdef.gravity = B2_LITERAL(b2Vec2){0.0f, -800.0f};
-    state.world = b2CreateWorld(&wdef);
+    state.world = create_world();
     state.accumulator = 0.0f;
 
     // PhysFS: init and mount current directory
     PHYSFS_init(nullptr);
-    PHYSFS_mount(".", nullptr, 1);
+    AssetPack::mount(".");
+    state.settings.load("project.txt");
 
     // Lua (sol2)
-    state.lua = new sol::state();
-    state.lua->open_libraries(sol::lib::base, sol::lib::math);
-    
-    // Bind input to Lua
-    state.lua->set_function("get_key", &InputSystem::get_key);
-    state.lua->set_function("get_key_down", &InputSystem::get_key_down);
-    state.lua->set_function("get_mouse_pos", &InputSystem::get_mouse_position);
-    state.lua->set_function("get_mouse_button", &InputSystem::get_mouse_button);
-    
-    // Bind component access to Lua
-    state.lua->set_function("get_transform", [](uint32_t entity_id, uint32_t generation) -> sol::optional<sol::table> {
-        EntityId e = {entity_id, generation};
-        Transform* t = state.registry.transforms.get(e);
-        if (!t) return sol::nullopt;
-        
-        sol::table result = state.lua->create_table();
-        result["x"] = t->position.X;
-        result["y"] = t->position.Y;
-        result["rotation"] = t->rotation;
-        return result;
-    });
-    
-    state.lua->set_function("set_transform", [](uint32_t entity_id, uint32_t generation, float x, float y) {
-        EntityId e = {entity_id, generation};
-        Transform* t = state.registry.transforms.get(e);
-        if (t) {
-            t->position.X = x;
-            t->position.Y = y;
-        }
-    });
-
-    state.lua->set_function("get_velocity", [](uint32_t entity_id, uint32_t generation) -> sol::optional<sol::table> {
-        EntityId e = {entity_id, generation};
-        Rigidbody* rb = state.registry.rigidbodies.get(e);
-        if (!rb || !b2Body_IsValid(rb->body)) return sol::nullopt;
-        
-        b2Vec2 vel = b2Body_GetLinearVelocity(rb->body);
-        sol::table result = state.lua->create_table();
-        result["x"] = vel.x;
-        result["y"] = vel.y;
-        return result;
-    });
-    
-    state.lua->set_function("set_velocity", [](uint32_t entity_id, uint32_t generation, float vx, float vy) {
-        EntityId e = {entity_id, generation};
-        Rigidbody* rb = state.registry.rigidbodies.get(e);
-        if (rb && b2Body_IsValid(rb->body)) {
-            b2Body_SetLinearVelocity(rb->body, b2Vec2{vx, vy});
-        }
-    });
-    
-    state.lua->set_function("apply_impulse", [](uint32_t entity_id, uint32_t generation, float ix, float iy) {
-        EntityId e = {entity_id, generation};
-        Rigidbody* rb = state.registry.rigidbodies.get(e);
-        if (rb && b2Body_IsValid(rb->body)) {
-            b2Body_ApplyLinearImpulseToCenter(rb->body, b2Vec2{ix, iy}, true);
-        }
-    });
-    
-    state.lua->set_function("destroy_entity", [](uint32_t entity_id, uint32_t generation) {
-        EntityId e = {entity_id, generation};
-        if (state.registry.valid(e)) {
-            state.registry.destroy(e);
-            log_console("Entity " + std::to_string(entity_id) + " destroyed by script");
-        }
-    });
-    
-    // Bind utility functions
-    state.lua->set_function("log", [](const std::string& msg) {
-        log_console("[Lua] " + msg);
-    });
-    
-    // Global game state for scripts
-    state.lua->set("game_over", false);
-    state.lua->set("game_score", 0);
+    state.lua = create_lua_state();
     
     log_console("Engine initialized");
     
@@ -821,6 +5390,33 @@ void init(void) {
     state.pass_action.colors[0].clear_value = {0.0f, 0.0f, 0.0f, 1.0f};
 }
 
+// Runs an inspector widget that edits one component of the selected entity and records
+// the change in EditorHistory
+template<typename Widget>
+static bool edit_tracked(EditorHistory::Component component, Widget&& widget) {
+    EditorHistory::Value before = EditorHistory::capture(state.registry, state.selected_entity, component);
+    bool changed = widget();
+    if (changed) {
+        EditorHistory::record(state.registry, state.selected_entity, component, ImGui::GetItemID(), std::move(before));
+    }
+    if (ImGui::IsItemDeactivated()) {
+        EditorHistory::seal();
+    }
+    return changed;
+}
+
+static void editor_undo() {
+    if (state.play_mode) return;
+    SceneStreamer::finish(state.registry, state.world);
+    EditorHistory::undo(state.registry, state.world, state.selected_entity);
+}
+
+static void editor_redo() {
+    if (state.play_mode) return;
+    SceneStreamer::finish(state.registry, state.world);
+    EditorHistory::redo(state.registry, state.world, state.selected_entity);
+}
+
 void frame(void) {
     const int width = sapp_width();
     const int height = sapp_height();
@@ -829,22 +5425,31 @@ void frame(void) {
     // Reset per-frame input
     InputSystem::reset();
 
+    SceneSaver::poll();
+    AssetManager::update(state.settings.texture_upload_budget_ms, state.settings.texture_budget_mb);
+    TextureAtlas::flush();
+    
+    // Instantiate the next slice of a scene being loaded
+    if (!state.play_mode) {
+        SceneStreamer::update(state.registry, state.world, state.settings.scene_stream_budget_ms);
+    }
+    
+    // Stream world cells around the camera. This runs per frame on a wall-clock budget,
+    // outside the fixed step, so recorded sessions don't capture cells and replays of
+    // sessions played inside a world are not deterministic.
+    HMM_Vec2 camera_pos;
+    if (ScriptSystem::camera_position(state.registry, camera_pos)) {
+        WorldPartition::update(state.registry, state.world, camera_pos, state.settings.scene_stream_budget_ms);
+    }
+
     // Physics fixed-step
-    const float step = 1.0f / 60.0f;
+    const float step = FIXED_STEP;
     state.accumulator += dt;
     while (state.accumulator >= step) {
         // Only update scripts and physics in play mode
         if (state.play_mode) {
-            // Update scripts
-            ScriptSystem::update_scripts(state.registry, state.lua, step);
-            
-            // Sync editor changes to physics
-            PhysicsSystem::sync_to_physics(state.registry, state.world);
-            
-            b2World_Step(state.world, step, 4);
-            
-            // Sync physics back to transforms
-            PhysicsSystem::sync_from_physics(state.registry, state.world);
+            InputRecorder::record_step();
+            fixed_update(step);
         }
         
         state.accumulator -= step;
@@ -890,6 +5495,7 @@ void frame(void) {
         ImGui::DockBuilderDockWindow("Inspector", dock_right);
         ImGui::DockBuilderDockWindow("Console", dock_bottom);
         ImGui::DockBuilderDockWindow("Assets", dock_bottom);
+        ImGui::DockBuilderDockWindow("Script Profiler", dock_bottom);
         ImGui::DockBuilderDockWindow("Viewport", dock_main);
         
         ImGui::DockBuilderFinish(dockspace_id);
@@ -899,34 +5505,65 @@ void frame(void) {
         if (ImGui::BeginMenu("File")) {
             if (ImGui::MenuItem("Save Scene", "Ctrl+S")) {
                 nfdchar_t* outPath = nullptr;
-                nfdfilteritem_t filters[1] = { { "Scene", "txt" } };
+                nfdfilteritem_t filters[1] = { { "Scene", "txt,3kscene" } };
                 nfdresult_t result = NFD_SaveDialog(&outPath, filters, 1, nullptr, "scene.txt");
                 if (result == NFD_OKAY) {
-                    SceneSerializer::save(outPath, state.registry);
+                    SceneStreamer::finish(state.registry, state.world);
+                    SceneSaver::save(outPath, state.registry, true);
                     state.current_scene_path = outPath;
                     NFD_FreePath(outPath);
-                    log_console("Scene saved: " + std::string(outPath));
                 }
             }
             if (ImGui::MenuItem("Load Scene", "Ctrl+L")) {
                 nfdchar_t* outPath = nullptr;
-                nfdfilteritem_t filters[1] = { { "Scene", "txt" } };
+                nfdfilteritem_t filters[1] = { { "Scene", "txt,3kscene" } };
                 nfdresult_t result = NFD_OpenDialog(&outPath, filters, 1, nullptr);
                 if (result == NFD_OKAY) {
-                    // Clear current scene
-                    std::vector<EntityId> to_delete;
-                    state.registry.transforms.each([&](EntityId e, Transform& t) {
-                        to_delete.push_back(e);
-                    });
-                    for (auto e : to_delete) {
-                        state.registry.destroy(e);
-                    }
-                    state.selected_entity = NULL_ENTITY;
+                    // Clear current scene, then stream the new one in over the next frames
+                    WorldPartition::close(state.registry);
+                    clear_scene();
                     
-                    SceneSerializer::load(outPath, state.registry, state.world);
-                    state.current_scene_path = outPath;
+                    SceneSaver::wait();
+                    if (SceneStreamer::begin(outPath, state.registry)) {
+                        state.current_scene_path = outPath;
+                    } else {
+                        log_console("Failed to load scene: " + std::string(outPath));
+                    }
+                    NFD_FreePath(outPath);
+                }
+            }
+            if (ImGui::MenuItem("Open World...")) {
+                nfdchar_t* outPath = nullptr;
+                nfdresult_t result = NFD_PickFolder(&outPath, nullptr);
+                if (result == NFD_OKAY) {
+                    WorldPartition::close(state.registry);
+                    clear_scene();
+                    SceneSaver::wait();
+                    if (WorldPartition::open(outPath, state.registry, state.world)) {
+                        state.current_scene_path = outPath;
+                        log_console("World opened: " + std::string(outPath));
+                    } else {
+                        log_console("Failed to open world (no world.txt): " + std::string(outPath));
+                    }
+                    NFD_FreePath(outPath);
+                }
+            }
+            if (ImGui::MenuItem("Load Texture Folder...")) {
+                nfdchar_t* outPath = nullptr;
+                nfdresult_t result = NFD_PickFolder(&outPath, nullptr);
+                if (result == NFD_OKAY) {
+                    size_t count = 0;
+                    std::error_code ec;
+                    for (const auto& item : std::filesystem::directory_iterator(outPath, ec)) {
+                        std::string ext = item.path().extension().string();
+                        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)tolower(c); });
+                        if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" || ext == ".tga") {
+                            AssetManager::load_texture(item.path().string().c_str());
+                            count++;
+                        }
+                    }
+                    log_console("Loading " + std::to_string(count) + " textures from " + std::string(outPath));
                     NFD_FreePath(outPath);
-                    log_console("Scene loaded: " + std::string(outPath));
                 }
             }
             ImGui::Separator();
@@ -936,30 +5573,34 @@ void frame(void) {
             ImGui::EndMenu();
         }
         
+        if (ImGui::BeginMenu("Edit")) {
+            if (ImGui::MenuItem("Undo", "Ctrl+Z", false, !state.play_mode && !EditorHistory::undo_stack.empty())) {
+                editor_undo();
+            }
+            if (ImGui::MenuItem("Redo", "Ctrl+Y", false, !state.play_mode && !EditorHistory::redo_stack.empty())) {
+                editor_redo();
+            }
+            ImGui::EndMenu();
+        }
+        
         // Play/Stop mode toggle
         if (ImGui::BeginMenu("Scene")) {
             if (state.play_mode) {
                 if (ImGui::MenuItem("Stop", "F5")) {
-                    state.play_mode = false;
-                    // Reload scene to reset state
-                    std::vector<EntityId> to_delete;
-                    state.registry.transforms.each([&](EntityId e, Transform& t) {
-                        to_delete.push_back(e);
-                    });
-                    for (auto e : to_delete) {
-                        state.registry.destroy(e);
-                    }
-                    state.selected_entity = NULL_ENTITY;
-                    SceneSerializer::load(state.current_scene_path.c_str(), state.registry, state.world);
+                    // current_scene_path may be a world directory, so restore the saved state
+                    restore_editor_state();
                     log_console("Stopped play mode");
                 }
             } else {
                 if (ImGui::MenuItem("Play", "F5")) {
                     // Save current state before playing
-                    SceneSerializer::save("_temp_editor_state.txt", state.registry);
+                    save_editor_state();
                     state.play_mode = true;
                     log_console("Started play mode");
                 }
+                if (ImGui::MenuItem("Play and Record Input")) {
+                    start_recording();
+                }
             }
             ImGui::EndMenu();
         }
@@ -971,6 +5612,7 @@ void frame(void) {
             ImGui::MenuItem("Viewport", nullptr, &show_viewport);
             ImGui::MenuItem("Console", nullptr, &show_console);
             ImGui::MenuItem("Assets", nullptr, &show_assets);
+            ImGui::MenuItem("Script Profiler", nullptr, &show_profiler);
             ImGui::Separator();
             ImGui::MenuItem("Demo Window", nullptr, &show_test_window);
             ImGui::EndMenu();
@@ -991,7 +5633,7 @@ void frame(void) {
             ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.22f, 0.65f, 0.40f, 1.0f));
             ImGui::PushStyleColor(ImGuiCol_ButtonActive, ImVec4(0.15f, 0.45f, 0.28f, 1.0f));
             if (ImGui::Button("Play", ImVec2(button_width, 0))) {
-                SceneSerializer::save("_temp_editor_state.txt", state.registry);
+                save_editor_state();
                 state.play_mode = true;
                 log_console("Entering Play mode");
             }
@@ -1001,16 +5643,7 @@ void frame(void) {
             ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.80f, 0.32f, 0.32f, 1.0f));
             ImGui::PushStyleColor(ImGuiCol_ButtonActive, ImVec4(0.60f, 0.20f, 0.20f, 1.0f));
             if (ImGui::Button("Stop", ImVec2(button_width, 0))) {
-                state.play_mode = false;
-                std::vector<EntityId> to_delete;
-                state.registry.transforms.each([&](EntityId e, Transform& t) {
-                    to_delete.push_back(e);
-                });
-                for (auto e : to_delete) {
-                    state.registry.destroy(e);
-                }
-                state.selected_entity = NULL_ENTITY;
-                SceneSerializer::load("_temp_editor_state.txt", state.registry, state.world);
+                restore_editor_state();
                 log_console("Exiting Play mode");
             }
             ImGui::PopStyleColor(3);
@@ -1055,6 +5688,13 @@ void frame(void) {
         ImGui::SmallButton(" EDITOR ");
         ImGui::PopStyleColor(2);
     }
+    if (InputRecorder::recording) {
+        ImGui::SameLine();
+        ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.75f, 0.22f, 0.22f, 1.0f));
+        ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.82f, 0.28f, 0.28f, 1.0f));
+        ImGui::SmallButton(" REC ");
+        ImGui::PopStyleColor(2);
+    }
     
     ImGui::SameLine();
     ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.5f, 0.52f, 0.58f, 1.0f));
@@ -1063,10 +5703,35 @@ void frame(void) {
     
     // Scene path
     ImGui::Text("Scene: %s", state.current_scene_path.empty() ? "Untitled" : state.current_scene_path.c_str());
+    if (!WorldPartition::root.empty()) {
+        size_t cell_count, entity_count;
+        WorldPartition::resident(cell_count, entity_count);
+        ImGui::SameLine();
+        ImGui::Text("Cells: %zu (%zu entities)", cell_count, entity_count);
+    }
+    if (!TextureAtlas::pages.empty()) {
+        ImGui::SameLine();
+        ImGui::Text("Atlas: %zu pages, %d sprite draws", TextureAtlas::pages.size(), viewport_sprite_draws);
+    }
+    if (size_t textures_loading = AssetManager::loading()) {
+        ImGui::SameLine();
+        ImGui::Text("Textures: %zu loading", textures_loading);
+    }
+    if (SceneStreamer::active) {
+        ImGui::SameLine();
+        char overlay[32];
+        snprintf(overlay, sizeof(overlay), "Loading %.0f%%", SceneStreamer::progress() * 100.0f);
+        ImGui::ProgressBar(SceneStreamer::progress(), ImVec2(160.0f, 14.0f), overlay);
+    }
     
     // Right side stats
-    float right_offset = viewport->Size.x - 280.0f;
+    float right_offset = viewport->Size.x - 560.0f;
     ImGui::SameLine(right_offset);
+    ImGui::Text("Lua: %u KB  GC %.2f / %.2f ms", (unsigned)ScriptGC::memory_kb(state.lua->lua_state()),
+                ScriptGC::last_slice_ms, ScriptGC::max_slice_ms);
+    ImGui::SameLine();
+    ImGui::Text("|");
+    ImGui::SameLine();
     ImGui::Text("Entities: %d", (int)state.registry.transforms.entities.size());
     ImGui::SameLine();
     ImGui::Text("|");
@@ -1092,6 +5757,7 @@ void frame(void) {
         if (ImGui::Button("+ New Entity", ImVec2(-1, 0))) {
             EntityId new_entity = state.registry.create();
             state.registry.transforms.add(new_entity, Transform());
+            EditorHistory::record_create(state.registry, new_entity);
             state.selected_entity = new_entity;
             log_console("Created entity " + std::to_string(new_entity.id));
         }
@@ -1102,7 +5768,7 @@ void frame(void) {
             ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.75f, 0.35f, 0.35f, 1.0f));
             ImGui::PushStyleColor(ImGuiCol_ButtonActive, ImVec4(0.55f, 0.22f, 0.22f, 1.0f));
             if (ImGui::Button("Delete Selected", ImVec2(-1, 0))) {
-                state.registry.destroy(state.selected_entity);
+                EditorHistory::destroy(state.registry, state.selected_entity);
                 log_console("Deleted entity " + std::to_string(state.selected_entity.id));
                 state.selected_entity = NULL_ENTITY;
             }
@@ -1165,7 +5831,12 @@ void frame(void) {
             ImGui::Text(" %s ", icon);
             ImGui::PopStyleColor();
             ImGui::SameLine(0, 0);
-            ImGui::Text("Entity_%u", e.id);
+            Name* name = state.registry.names.get(e);
+            if (name) {
+                ImGui::Text("%s", name->value.c_str());
+            } else {
+                ImGui::Text("Entity_%u", e.id);
+            }
             
             if (is_selected) {
                 ImGui::PopStyleColor(2);
@@ -1197,6 +5868,27 @@ void frame(void) {
             ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.5f, 0.5f, 0.5f, 1.0f));
             ImGui::Text("Generation: %u", state.selected_entity.generation);
             ImGui::PopStyleColor();
+            
+            // Name and tag go through the registry so its lookup indices stay current
+            char text_buf[128];
+            Name* name = state.registry.names.get(state.selected_entity);
+            strncpy(text_buf, name ? name->value.c_str() : "", sizeof(text_buf));
+            text_buf[sizeof(text_buf)-1] = '\0';
+            ImGui::PushItemWidth(-1);
+            edit_tracked(EditorHistory::NAME, [&] {
+                if (!ImGui::InputTextWithHint("##Name", "Name", text_buf, sizeof(text_buf))) return false;
+                state.registry.set_name(state.selected_entity, text_buf);
+                return true;
+            });
+            Tag* tag = state.registry.tags.get(state.selected_entity);
+            strncpy(text_buf, tag ? tag->value.c_str() : "", sizeof(text_buf));
+            text_buf[sizeof(text_buf)-1] = '\0';
+            edit_tracked(EditorHistory::TAG, [&] {
+                if (!ImGui::InputTextWithHint("##Tag", "Tag", text_buf, sizeof(text_buf))) return false;
+                state.registry.set_tag(state.selected_entity, text_buf);
+                return true;
+            });
+            ImGui::PopItemWidth();
             ImGui::Separator();
             
             // Transform component
@@ -1206,11 +5898,17 @@ void frame(void) {
                 if (ImGui::CollapsingHeader("Transform", ImGuiTreeNodeFlags_DefaultOpen | ImGuiTreeNodeFlags_DefaultOpen)) {
                     ImGui::Indent(8.0f);
                     ImGui::Text("Position");
-                    ImGui::DragFloat2("##Position", &transform->position.X, 1.0f, -10000.0f, 10000.0f, "%.2f");
+                    edit_tracked(EditorHistory::TRANSFORM, [&] {
+                        return ImGui::DragFloat2("##Position", &transform->position.X, 1.0f, -10000.0f, 10000.0f, "%.2f");
+                    });
                     ImGui::Text("Rotation");
-                    ImGui::DragFloat("##Rotation", &transform->rotation, 0.01f, -360.0f, 360.0f, "%.2f deg");
+                    edit_tracked(EditorHistory::TRANSFORM, [&] {
+                        return ImGui::DragFloat("##Rotation", &transform->rotation, 0.01f, -360.0f, 360.0f, "%.2f deg");
+                    });
                     ImGui::Text("Scale");
-                    ImGui::DragFloat2("##Scale", &transform->scale.X, 0.01f, 0.01f, 100.0f, "%.2f");
+                    edit_tracked(EditorHistory::TRANSFORM, [&] {
+                        return ImGui::DragFloat2("##Scale", &transform->scale.X, 0.01f, 0.01f, 100.0f, "%.2f");
+                    });
                     ImGui::Unindent(8.0f);
                 }
                 ImGui::PopStyleVar();
@@ -1223,9 +5921,11 @@ void frame(void) {
                 if (ImGui::CollapsingHeader("Sprite", ImGuiTreeNodeFlags_DefaultOpen)) {
                     ImGui::Indent(8.0f);
                     ImGui::Text("Color");
-                    ImGui::ColorEdit4("##Color", &sprite->color.X);
+                    edit_tracked(EditorHistory::SPRITE, [&] { return ImGui::ColorEdit4("##Color", &sprite->color.X); });
                     ImGui::Text("Size");
-                    ImGui::DragFloat2("##Size", &sprite->size.X, 1.0f, 1.0f, 500.0f, "%.1f");
+                    edit_tracked(EditorHistory::SPRITE, [&] {
+                        return ImGui::DragFloat2("##Size", &sprite->size.X, 1.0f, 1.0f, 500.0f, "%.1f");
+                    });
                     
                     // Texture loading
                     static char tex_path[256] = "";
@@ -1242,19 +5942,21 @@ void frame(void) {
                             NFD_FreePath(outPath);
                         }
                     }
-                    if (ImGui::Button("Load Texture", ImVec2(-1, 0))) {
-                        sg_image img = AssetManager::load_texture(tex_path);
-                        if (img.id != SG_INVALID_ID) {
-                            sprite->texture = img;
-                            log_console("Texture loaded: " + std::string(tex_path));
-                        } else {
+                    edit_tracked(EditorHistory::SPRITE, [&] {
+                        if (!ImGui::Button("Load Texture", ImVec2(-1, 0))) return false;
+                        TextureRef texture = AssetManager::load_texture(tex_path);
+                        if (!texture.valid()) {
                             log_console("Failed to load texture: " + std::string(tex_path));
+                            return false;
                         }
-                    }
+                        sprite->texture = std::move(texture);
+                        return true;
+                    });
                     
-                    bool has_tex = sprite->texture.id != SG_INVALID_ID;
+                    sg_resource_state tex_state = AssetManager::state(sprite->texture);
+                    bool has_tex = tex_state == SG_RESOURCESTATE_VALID;
                     ImGui::PushStyleColor(ImGuiCol_Text, has_tex ? ImVec4(0.3f, 1.0f, 0.3f, 1.0f) : ImVec4(0.6f, 0.6f, 0.6f, 1.0f));
-                    ImGui::Text(has_tex ? "  Texture: Loaded" : "  Texture: None");
+                    ImGui::Text(has_tex ? "  Texture: Loaded" : tex_state == SG_RESOURCESTATE_ALLOC ? "  Texture: Loading..." : "  Texture: None");
                     ImGui::PopStyleColor();
                     ImGui::Unindent(8.0f);
                 }
@@ -1262,9 +5964,11 @@ void frame(void) {
             } else {
                 ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.25f, 0.25f, 0.25f, 0.8f));
                 ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.35f, 0.35f, 0.35f, 1.0f));
-                if (ImGui::Button("+ Add Sprite Component", ImVec2(-1, 0))) {
+                edit_tracked(EditorHistory::SPRITE, [&] {
+                    if (!ImGui::Button("+ Add Sprite Component", ImVec2(-1, 0))) return false;
                     state.registry.sprites.add(state.selected_entity, Sprite());
-                }
+                    return true;
+                });
                 ImGui::PopStyleColor(2);
             }
             
@@ -1283,54 +5987,44 @@ void frame(void) {
                     const char* body_types[] = { "Static", "Kinematic", "Dynamic" };
                     int current_type = (int)rb->body_type;
                     ImGui::Text("Body Type");
-                    if (ImGui::Combo("##BodyType", &current_type, body_types, 3)) {
+                    edit_tracked(EditorHistory::RIGIDBODY, [&] {
+                        if (!ImGui::Combo("##BodyType", &current_type, body_types, 3)) return false;
                         rb->body_type = (b2BodyType)current_type;
                         if (has_body) {
                             b2Body_SetType(rb->body, rb->body_type);
                         }
-                    }
+                        return true;
+                    });
                     
                     // Fixed rotation
                     ImGui::Text("Fixed Rotation");
-                    if (ImGui::Checkbox("##FixedRot", &rb->fixed_rotation)) {
+                    edit_tracked(EditorHistory::RIGIDBODY, [&] {
+                        if (!ImGui::Checkbox("##FixedRot", &rb->fixed_rotation)) return false;
                         if (has_body) {
                             b2Body_SetFixedRotation(rb->body, rb->fixed_rotation);
                         }
-                    }
+                        return true;
+                    });
                     
                     // Physics properties
                     ImGui::Text("Density");
-                    ImGui::DragFloat("##Density", &rb->density, 0.1f, 0.0f, 100.0f, "%.2f");
+                    edit_tracked(EditorHistory::RIGIDBODY, [&] {
+                        return ImGui::DragFloat("##Density", &rb->density, 0.1f, 0.0f, 100.0f, "%.2f");
+                    });
                     ImGui::Text("Friction");
-                    ImGui::DragFloat("##Friction", &rb->friction, 0.01f, 0.0f, 1.0f, "%.2f");
+                    edit_tracked(EditorHistory::RIGIDBODY, [&] {
+                        return ImGui::DragFloat("##Friction", &rb->friction, 0.01f, 0.0f, 1.0f, "%.2f");
+                    });
                     ImGui::Text("Restitution");
-                    ImGui::DragFloat("##Restitution", &rb->restitution, 0.01f, 0.0f, 1.0f, "%.2f");
+                    edit_tracked(EditorHistory::RIGIDBODY, [&] {
+                        return ImGui::DragFloat("##Restitution", &rb->restitution, 0.01f, 0.0f, 1.0f, "%.2f");
+                    });
                     
                     if (!has_body) {
                         ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.2f, 0.5f, 0.8f, 0.8f));
                         ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.3f, 0.6f, 0.9f, 1.0f));
                         if (ImGui::Button("Create Box2D Body", ImVec2(-1, 0))) {
-                            b2BodyDef bodyDef = b2DefaultBodyDef();
-                            Transform* t = state.registry.transforms.get(state.selected_entity);
-                            if (t) {
-                                bodyDef.position = b2Vec2{t->position.X, t->position.Y};
-                                bodyDef.rotation = b2MakeRot(t->rotation);
-                            }
-                            bodyDef.type = rb->body_type;
-                            bodyDef.fixedRotation = rb->fixed_rotation;
-                            rb->body = b2CreateBody(state.world, &bodyDef);
-                            
-                            // Add a box shape
-                            Sprite* sprite = state.registry.sprites.get(state.selected_entity);
-                            float hw = sprite ? sprite->size.X * 0.5f : 50.0f;
-                            float hh = sprite ? sprite->size.Y * 0.5f : 50.0f;
-                            b2Polygon box = b2MakeBox(hw, hh);
-                            b2ShapeDef shapeDef = b2DefaultShapeDef();
-                            shapeDef.density = rb->density;
-                            shapeDef.material.friction = rb->friction;
-                            shapeDef.material.restitution = rb->restitution;
-                            b2CreatePolygonShape(rb->body, &shapeDef, &box);
-                            
+                            PhysicsSystem::create_body(state.registry, state.world, state.selected_entity, *rb);
                             log_console("Created Box2D body for entity " + std::to_string(state.selected_entity.id));
                         }
                         ImGui::PopStyleColor(2);
@@ -1341,9 +6035,11 @@ void frame(void) {
             } else {
                 ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.25f, 0.25f, 0.25f, 0.8f));
                 ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.35f, 0.35f, 0.35f, 1.0f));
-                if (ImGui::Button("+ Add Rigidbody Component", ImVec2(-1, 0))) {
+                edit_tracked(EditorHistory::RIGIDBODY, [&] {
+                    if (!ImGui::Button("+ Add Rigidbody Component", ImVec2(-1, 0))) return false;
                     state.registry.rigidbodies.add(state.selected_entity, Rigidbody());
-                }
+                    return true;
+                });
                 ImGui::PopStyleColor(2);
             }
             
@@ -1358,33 +6054,50 @@ void frame(void) {
                     buf[sizeof(buf)-1] = '\0';
                     ImGui::Text("Script Path");
                     ImGui::PushItemWidth(-1);
-                    if (ImGui::InputText("##ScriptPath", buf, sizeof(buf))) {
+                    edit_tracked(EditorHistory::SCRIPT, [&] {
+                        if (!ImGui::InputText("##ScriptPath", buf, sizeof(buf))) return false;
                         script->path = buf;
                         script->loaded = false; // Force reload
-                    }
+                        script->disabled = false;
+                        return true;
+                    });
                     ImGui::PopItemWidth();
-                    if (ImGui::Button("Browse...", ImVec2(-1, 0))) {
+                    edit_tracked(EditorHistory::SCRIPT, [&] {
+                        if (!ImGui::Button("Browse...", ImVec2(-1, 0))) return false;
                         nfdchar_t* outPath = nullptr;
                         nfdfilteritem_t filters[1] = { { "Lua Script", "lua" } };
                         nfdresult_t result = NFD_OpenDialog(&outPath, filters, 1, nullptr);
-                        if (result == NFD_OKAY) {
-                            script->path = outPath;
-                            script->loaded = false; // Force reload
-                            NFD_FreePath(outPath);
+                        if (result != NFD_OKAY) return false;
+                        script->path = outPath;
+                        script->loaded = false; // Force reload
+                        script->disabled = false;
+                        NFD_FreePath(outPath);
+                        return true;
+                    });
+                    if (script->disabled) {
+                        ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.35f, 0.3f, 1.0f));
+                        ImGui::Text("  Status: Disabled (over budget)");
+                        ImGui::PopStyleColor();
+                        if (ImGui::Button("Re-enable", ImVec2(-1, 0))) {
+                            script->loaded = false;
+                            script->disabled = false;
                         }
+                    } else {
+                        ImGui::PushStyleColor(ImGuiCol_Text, script->loaded ? ImVec4(0.3f, 1.0f, 0.3f, 1.0f) : ImVec4(0.6f, 0.6f, 0.6f, 1.0f));
+                        ImGui::Text(script->loaded ? "  Status: Loaded" : "  Status: Not Loaded");
+                        ImGui::PopStyleColor();
                     }
-                    ImGui::PushStyleColor(ImGuiCol_Text, script->loaded ? ImVec4(0.3f, 1.0f, 0.3f, 1.0f) : ImVec4(0.6f, 0.6f, 0.6f, 1.0f));
-                    ImGui::Text(script->loaded ? "  Status: Loaded" : "  Status: Not Loaded");
-                    ImGui::PopStyleColor();
                     ImGui::Unindent(8.0f);
                 }
                 ImGui::PopStyleVar();
             } else {
                 ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.25f, 0.25f, 0.25f, 0.8f));
                 ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.35f, 0.35f, 0.35f, 1.0f));
-                if (ImGui::Button("+ Add Script Component", ImVec2(-1, 0))) {
+                edit_tracked(EditorHistory::SCRIPT, [&] {
+                    if (!ImGui::Button("+ Add Script Component", ImVec2(-1, 0))) return false;
                     state.registry.scripts.add(state.selected_entity, Script());
-                }
+                    return true;
+                });
                 ImGui::PopStyleColor(2);
             }
             
@@ -1395,18 +6108,24 @@ void frame(void) {
                 if (ImGui::CollapsingHeader("Camera", ImGuiTreeNodeFlags_DefaultOpen)) {
                     ImGui::Indent(8.0f);
                     ImGui::Text("Zoom");
-                    ImGui::DragFloat("##Zoom", &camera->zoom, 0.01f, 0.1f, 10.0f, "%.2f");
+                    edit_tracked(EditorHistory::CAMERA, [&] {
+                        return ImGui::DragFloat("##Zoom", &camera->zoom, 0.01f, 0.1f, 10.0f, "%.2f");
+                    });
                     ImGui::Text("Offset");
-                    ImGui::DragFloat2("##Offset", &camera->offset.X, 1.0f, -1000.0f, 1000.0f, "%.1f");
+                    edit_tracked(EditorHistory::CAMERA, [&] {
+                        return ImGui::DragFloat2("##Offset", &camera->offset.X, 1.0f, -1000.0f, 1000.0f, "%.1f");
+                    });
                     ImGui::Unindent(8.0f);
                 }
                 ImGui::PopStyleVar();
             } else {
                 ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.25f, 0.25f, 0.25f, 0.8f));
                 ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.35f, 0.35f, 0.35f, 1.0f));
-                if (ImGui::Button("+ Add Camera Component", ImVec2(-1, 0))) {
+                edit_tracked(EditorHistory::CAMERA, [&] {
+                    if (!ImGui::Button("+ Add Camera Component", ImVec2(-1, 0))) return false;
                     state.registry.cameras.add(state.selected_entity, Camera());
-                }
+                    return true;
+                });
                 ImGui::PopStyleColor(2);
             }
             
@@ -1463,8 +6182,13 @@ void frame(void) {
         dl->AddLine(ImVec2(center.x, center.y - 40), ImVec2(center.x, center.y + 40), axis_color_y, 1.5f);
         dl->AddCircle(center, 4.0f, IM_COL32(100, 100, 100, 150), 12, 1.0f);
         
-        // Render all entities with Transform + Sprite
+        // Render all entities with Transform + Sprite. Every sprite is a textured quad from
+        // the atlas, so consecutive sprites on one page share a draw command.
         ImVec2 viewport_center = center;
+        const TextureAtlas::Region& white = TextureAtlas::white_region();
+        ImVec2 selected_corners[4];
+        bool selection_visible = false;
+        int first_cmd = dl->CmdBuffer.Size;
         state.registry.transforms.each([&](EntityId e, Transform& t) {
             Sprite* sprite = state.registry.sprites.get(e);
             if (sprite) {
@@ -1498,18 +6222,34 @@ void frame(void) {
                 ImU32 col = IM_COL32((int)(sprite->color.X*255), (int)(sprite->color.Y*255), 
                                      (int)(sprite->color.Z*255), (int)(sprite->color.W*255));
                 
-                // Draw filled quad
-                dl->AddQuadFilled(corners[0], corners[1], corners[2], corners[3], col);
+                // Textured quad, or a flat one while the texture is missing or still loading
+                const AssetManager::Texture* texture = AssetManager::use(sprite->texture);
+                if (texture) {
+                    const TextureAtlas::Region& region = texture->region;
+                    dl->AddImageQuad(region.texture, corners[0], corners[1], corners[2], corners[3],
+                                     region.uv0, ImVec2(region.uv1.x, region.uv0.y), region.uv1,
+                                     ImVec2(region.uv0.x, region.uv1.y), col);
+                } else {
+                    dl->AddImageQuad(white.texture, corners[0], corners[1], corners[2], corners[3],
+                                     white.uv0, white.uv0, white.uv1, white.uv1, col);
+                }
                 
-                // Professional selection highlight
                 if (e == state.selected_entity) {
-                    // Outer glow
-                    dl->AddQuad(corners[0], corners[1], corners[2], corners[3], IM_COL32(100, 150, 255, 200), 3.0f);
-                    // Inner border
-                    dl->AddQuad(corners[0], corners[1], corners[2], corners[3], IM_COL32(200, 220, 255, 255), 1.5f);
+                    memcpy(selected_corners, corners, sizeof(corners));
+                    selection_visible = true;
                 }
             }
         });
+        viewport_sprite_draws = dl->CmdBuffer.Size - first_cmd + 1;
+        
+        // Professional selection highlight, drawn last so it doesn't split sprite batches
+        if (selection_visible) {
+            ImVec2* c = selected_corners;
+            // Outer glow
+            dl->AddQuad(c[0], c[1], c[2], c[3], IM_COL32(100, 150, 255, 200), 3.0f);
+            // Inner border
+            dl->AddQuad(c[0], c[1], c[2], c[3], IM_COL32(200, 220, 255, 255), 1.5f);
+        }
         
         // Handle viewport click to select entity
         if (ImGui::IsWindowHovered() && ImGui::IsMouseClicked(0)) {
@@ -1628,15 +6368,20 @@ void frame(void) {
         ImGui::PopStyleColor();
         ImGui::SameLine(ImGui::GetWindowWidth() - 40);
         ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.26f, 0.71f, 0.78f, 1.0f));
-        ImGui::Text("(%d)", (int)AssetManager::textures.size());
+        ImGui::Text("(%d)", (int)AssetManager::slots_by_path.size());
         ImGui::PopStyleColor();
         
         ImGui::Indent(10.0f);
-        if (!AssetManager::textures.empty()) {
+        if (!AssetManager::slots_by_path.empty()) {
             ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(4.0f, 4.0f));
-            for (const auto& pair : AssetManager::textures) {
+            ImGui::Text("%.1f / %.0f MB", (double)AssetManager::resident_bytes / (1024.0 * 1024.0),
+                        state.settings.texture_budget_mb);
+            for (uint32_t i = 0; i < (uint32_t)AssetManager::textures.size(); ++i) {
+                const AssetManager::Texture& texture = AssetManager::textures[i];
+                if (texture.path.empty()) continue;
                 ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.78f, 0.80f, 0.84f, 1.0f));
-                ImGui::BulletText("%s", pair.first.c_str());
+                ImGui::BulletText("%s (%u refs, %zu KB)", texture.path.c_str(), TextureRef::counts[i].refs,
+                                  texture.bytes / 1024);
                 ImGui::PopStyleColor();
             }
             ImGui::PopStyleVar();
@@ -1664,6 +6409,72 @@ void frame(void) {
         ImGui::End();
     }
     
+    // 6. Script profiler window
+    if (show_profiler) {
+        ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(8.0f, 8.0f));
+        ImGui::Begin("Script Profiler", &show_profiler);
+        ImGui::PopStyleVar();
+        
+        if (ImGui::Checkbox("Enabled", &ScriptProfiler::enabled)) {
+            install_script_hook(state.lua->lua_state());
+        }
+        ImGui::SameLine();
+        if (ImGui::Checkbox("Sample stacks", &ScriptProfiler::sampling)) {
+            install_script_hook(state.lua->lua_state());
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Reset")) {
+            ScriptProfiler::reset();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Dump Folded")) {
+            if (ScriptProfiler::dump_folded("script_profile.folded")) {
+                log_console("Wrote script_profile.folded");
+            }
+        }
+        
+        ImGui::Spacing();
+        if (ImGui::BeginTable("ScriptPaths", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_SizingStretchProp)) {
+            ImGui::TableSetupColumn("Script");
+            ImGui::TableSetupColumn("Calls");
+            ImGui::TableSetupColumn("Total ms");
+            ImGui::TableSetupColumn("Avg us");
+            ImGui::TableSetupColumn("Max us");
+            ImGui::TableHeadersRow();
+            for (const auto& stats : ScriptProfiler::paths) {
+                if (stats.calls == 0) continue;
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn(); ImGui::Text("%s", stats.path.c_str());
+                ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)stats.calls);
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.total_ms);
+                ImGui::TableNextColumn(); ImGui::Text("%.2f", stats.total_ms * 1000.0 / stats.calls);
+                ImGui::TableNextColumn(); ImGui::Text("%.2f", stats.max_ms * 1000.0);
+            }
+            ImGui::EndTable();
+        }
+        
+        // Hottest source lines: sampled time grouped by the leaf of each stack
+        if (ScriptProfiler::sampling && !ScriptProfiler::stacks.empty()) {
+            std::unordered_map<std::string, double> lines;
+            for (const auto& pair : ScriptProfiler::stacks) {
+                size_t sep = pair.first.rfind(';');
+                lines[sep == std::string::npos ? pair.first : pair.first.substr(sep + 1)] += pair.second;
+            }
+            std::vector<std::pair<std::string, double>> sorted(lines.begin(), lines.end());
+            std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+            
+            ImGui::Spacing();
+            ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.55f, 0.58f, 0.65f, 1.0f));
+            ImGui::Text("HOT LINES");
+            ImGui::PopStyleColor();
+            for (size_t i = 0; i < sorted.size() && i < 10; ++i) {
+                ImGui::Text("%10.3f ms  %s", sorted[i].second / 1000.0, sorted[i].first.c_str());
+            }
+        }
+        
+        ImGui::End();
+    }
+    
     // Demo window
     if (show_test_window) {
         ImGui::ShowDemoWindow(&show_test_window);
@@ -1679,22 +6490,24 @@ void frame(void) {
     simgui_render();
     sg_end_pass();
     sg_commit();
+    
+    // Lua GC slice at the end of the frame, after all script work
+    ScriptGC::step(state.lua->lua_state());
 }
 
 void cleanup(void) {
     state.play_mode = false;
-    std::vector<EntityId> to_delete;
-    state.registry.transforms.each([&](EntityId e, Transform& t) {
-        to_delete.push_back(e);
-    });
-    for (auto e : to_delete) {
-        state.registry.destroy(e);
-    }
+    finish_recording();
+    WorldPartition::close(state.registry);
+    clear_scene();
+    SceneSaver::shutdown();
 
     AssetManager::cleanup();
+    TextureAtlas::cleanup();
     sgimgui_discard(&state.sgimgui);
     simgui_shutdown();
     b2DestroyWorld(state.world);
+    ScriptShards::shutdown();
     if (state.lua) { delete state.lua; state.lua = nullptr; }
     PHYSFS_deinit();
     NFD_Quit();
@@ -1704,22 +6517,23 @@ void cleanup(void) {
 void event(const sapp_event* e) {
     simgui_handle_event(e);
     
+    // Ctrl+Z / Ctrl+Y (or Ctrl+Shift+Z) undo and redo; text fields keep their own undo
+    if (e->type == SAPP_EVENTTYPE_KEY_DOWN && (e->modifiers & SAPP_MODIFIER_CTRL) && !ImGui::GetIO().WantTextInput) {
+        bool shift = (e->modifiers & SAPP_MODIFIER_SHIFT) != 0;
+        if (e->key_code == SAPP_KEYCODE_Z && !shift) {
+            editor_undo();
+        } else if (e->key_code == SAPP_KEYCODE_Y || (e->key_code == SAPP_KEYCODE_Z && shift)) {
+            editor_redo();
+        }
+    }
+    
     // F5 to toggle play mode
     if (e->type == SAPP_EVENTTYPE_KEY_DOWN && e->key_code == SAPP_KEYCODE_F5) {
         if (!state.play_mode) {
-            SceneSerializer::save("_temp_editor_state.txt", state.registry);
+            save_editor_state();
             state.play_mode = true;
         } else {
-            state.play_mode = false;
-            std::vector<EntityId> to_delete;
-            state.registry.transforms.each([&](EntityId e, Transform& t) {
-                to_delete.push_back(e);
-            });
-            for (auto e : to_delete) {
-                state.registry.destroy(e);
-            }
-            state.selected_entity = NULL_ENTITY;
-            SceneSerializer::load("_temp_editor_state.txt", state.registry, state.world);
+            restore_editor_state();
         }
     }
     
@@ -1743,6 +6557,83 @@ void event(const sapp_event* e) {
 }
 
 sapp_desc sokol_main(int argc, char* argv[]) {
+    // Headless modes run to completion and exit before a window is created
+    const char* replay_path = nullptr;
+    int repeat = 1;
+    int bench_scripts = 0;
+    int bench_steps = 300;
+    int bench_scene = 0;
+    int bench_world = 0;
+    const char* bench_textures = nullptr;
+    const char* partition_in = nullptr;
+    const char* partition_out = nullptr;
+    float partition_cell = 0.0f;
+    const char* convert_in = nullptr;
+    const char* convert_out = nullptr;
+    const char* pack_out = nullptr;
+    std::vector<const char*> pack_dirs;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--bench-scripts") == 0 && i + 1 < argc) {
+            bench_scripts = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--bench-scene") == 0 && i + 1 < argc) {
+            bench_scene = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--bench-textures") == 0 && i + 1 < argc) {
+            bench_textures = argv[++i];
+        } else if (strcmp(argv[i], "--bench-world") == 0 && i + 1 < argc) {
+            bench_world = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--partition-scene") == 0 && i + 3 < argc) {
+            partition_in = argv[++i];
+            partition_out = argv[++i];
+            partition_cell = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc) {
+            pack_out = argv[++i];
+            while (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+                pack_dirs.push_back(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--convert-scene") == 0 && i + 2 < argc) {
+            convert_in = argv[++i];
+            convert_out = argv[++i];
+        } else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            bench_steps = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            headless_quiet = true;
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            script_shards_override = std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            ScriptProfiler::enabled = true;
+            ScriptProfiler::sampling = true;
+        }
+    }
+    if (replay_path) {
+        exit(run_replay(replay_path, repeat));
+    }
+    if (bench_scripts > 0) {
+        exit(run_script_bench(bench_scripts, bench_steps));
+    }
+    if (bench_scene > 0) {
+        exit(run_scene_bench(bench_scene));
+    }
+    if (convert_in) {
+        exit(run_scene_convert(convert_in, convert_out));
+    }
+    if (pack_out) {
+        if (pack_dirs.empty()) pack_dirs.push_back(".");
+        exit(run_pack(pack_out, pack_dirs));
+    }
+    if (bench_textures) {
+        exit(run_texture_bench(bench_textures));
+    }
+    if (bench_world > 0) {
+        exit(run_world_bench(bench_world, bench_steps));
+    }
+    if (partition_in) {
+        exit(run_world_partition(partition_in, partition_out, partition_cell));
+    }
+    
     sapp_desc _sapp_desc{};
     _sapp_desc.init_cb = init;
     _sapp_desc.frame_cb = frame;